@@ -0,0 +1,508 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : bcache.c                                                         */
+/* Notes   : Sector buffer cache                                              */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <memory.h>
+#include "bcache.h"
+
+#define BCACHE_RUN_MAX			64		/* iovec elements per device call */
+#define TO_BCACHE( a )			( ( BCACHE* )( a )->pdata )
+
+/* walks a contiguous buffer or an iovec list one sector at a time */
+typedef struct
+{
+	const DISK_IOVEC*	iov;
+	int					iovCount;
+	int					index;
+	SECTOR				used;
+	BYTE*				data;
+	UINT32				bytesPerSector;
+} BCACHE_CURSOR;
+
+/* a run of sectors which is sent to the device in one call */
+typedef struct
+{
+	SECTOR		start;
+	SECTOR		count;
+	int			iovCount;
+	DISK_IOVEC	iov[BCACHE_RUN_MAX];
+} BCACHE_RUN;
+
+int bcache_read( DISK_OPERATIONS* this, SECTOR sector, void* data );
+int bcache_write( DISK_OPERATIONS* this, SECTOR sector, const void* data );
+int bcache_read_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, void* data, const DISK_IOVEC* iov, int iovCount );
+int bcache_write_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, const void* data, const DISK_IOVEC* iov, int iovCount );
+
+int bcache_init( BCACHE* cache, DISK_OPERATIONS* device, UINT32 numberOfBuffers )
+{
+	UINT32	i, hashSize = 1;
+
+	if( cache == NULL || device == NULL )
+		return -1;
+
+	ZeroMemory( cache, sizeof( BCACHE ) );
+
+	if( numberOfBuffers == 0 )
+		numberOfBuffers = BCACHE_DEFAULT_BUFFERS;
+
+	while( hashSize < numberOfBuffers ) // hash 크기는 2의 거듭제곱
+		hashSize <<= 1;
+
+	cache->buffers	= ( BCACHE_BUFFER* )calloc( numberOfBuffers, sizeof( BCACHE_BUFFER ) );
+	cache->hash		= ( BCACHE_BUFFER** )calloc( hashSize, sizeof( BCACHE_BUFFER* ) );
+	cache->data		= ( BYTE* )malloc( ( size_t )numberOfBuffers * device->bytesPerSector );
+	if( cache->buffers == NULL || cache->hash == NULL || cache->data == NULL )
+	{
+		free( cache->buffers );
+		free( cache->hash );
+		free( cache->data );
+		return -1;
+	}
+
+	cache->device			= device;
+	cache->numberOfBuffers	= numberOfBuffers;
+	cache->hashMask			= hashSize - 1;
+
+	for( i = 0; i < numberOfBuffers; i++ ) // 모든 버퍼를 비어있는 상태로 LRU list에 연결
+	{
+		cache->buffers[i].data = &cache->data[( size_t )i * device->bytesPerSector];
+		cache->buffers[i].prev = ( i == 0 ? NULL : &cache->buffers[i - 1] );
+		cache->buffers[i].next = ( i == numberOfBuffers - 1 ? NULL : &cache->buffers[i + 1] );
+	}
+	cache->head = &cache->buffers[0];
+	cache->tail = &cache->buffers[numberOfBuffers - 1];
+
+	cache->disk.read_sector		= bcache_read;
+	cache->disk.write_sector	= bcache_write;
+	cache->disk.read_sectors	= bcache_read_sectors;
+	cache->disk.write_sectors	= bcache_write_sectors;
+	cache->disk.numberOfSectors	= device->numberOfSectors;
+	cache->disk.bytesPerSector	= device->bytesPerSector;
+	cache->disk.pdata			= cache;
+
+	return 0;
+}
+
+void bcache_uninit( BCACHE* cache )
+{
+	if( cache == NULL || cache->buffers == NULL )
+		return;
+
+	bcache_flush( cache );
+
+	free( cache->buffers );
+	free( cache->hash );
+	free( cache->data );
+	cache->buffers = NULL;
+	cache->hash = NULL;
+	cache->data = NULL;
+}
+
+BCACHE_BUFFER* bcache_find( BCACHE* cache, SECTOR sector )
+{
+	BCACHE_BUFFER*	buffer = cache->hash[sector & cache->hashMask];
+
+	while( buffer && buffer->sector != sector )
+		buffer = buffer->hashNext;
+
+	return buffer;
+}
+
+void bcache_touch( BCACHE* cache, BCACHE_BUFFER* buffer ) // LRU list의 맨 앞으로 이동
+{
+	if( cache->head == buffer )
+		return;
+
+	buffer->prev->next = buffer->next;
+	if( buffer->next )
+		buffer->next->prev = buffer->prev;
+	else
+		cache->tail = buffer->prev;
+
+	buffer->prev = NULL;
+	buffer->next = cache->head;
+	cache->head->prev = buffer;
+	cache->head = buffer;
+}
+
+void bcache_unhash( BCACHE* cache, BCACHE_BUFFER* buffer )
+{
+	BCACHE_BUFFER**	link = &cache->hash[buffer->sector & cache->hashMask];
+
+	while( *link != buffer )
+		link = &( *link )->hashNext;
+
+	*link = buffer->hashNext;
+	buffer->hashNext = NULL;
+	buffer->valid = 0;
+}
+
+/* takes the least recently used buffer for a new sector, writing it back first if it is dirty */
+BCACHE_BUFFER* bcache_get_buffer( BCACHE* cache, SECTOR sector )
+{
+	BCACHE_BUFFER*	buffer = cache->tail;
+
+	if( buffer->valid )
+	{
+		if( buffer->dirty && cache->device->write_sector( cache->device, buffer->sector, buffer->data ) )
+			return NULL;
+
+		bcache_unhash( cache, buffer );
+	}
+
+	buffer->sector		= sector;
+	buffer->valid		= 1;
+	buffer->dirty		= 0;
+	buffer->hashNext	= cache->hash[sector & cache->hashMask];
+	cache->hash[sector & cache->hashMask] = buffer;
+
+	bcache_touch( cache, buffer );
+
+	return buffer;
+}
+
+int bcache_read( DISK_OPERATIONS* this, SECTOR sector, void* data )
+{
+	BCACHE*			cache = TO_BCACHE( this );
+	BCACHE_BUFFER*	buffer;
+
+	buffer = bcache_find( cache, sector );
+	if( buffer == NULL )
+	{
+		buffer = bcache_get_buffer( cache, sector );
+		if( buffer == NULL )
+			return -1;
+
+		if( cache->device->read_sector( cache->device, sector, buffer->data ) )
+		{
+			bcache_unhash( cache, buffer );
+			return -1;
+		}
+	}
+
+	bcache_touch( cache, buffer );
+	memcpy( data, buffer->data, this->bytesPerSector );
+
+	return 0;
+}
+
+int bcache_write( DISK_OPERATIONS* this, SECTOR sector, const void* data )
+{
+	BCACHE*			cache = TO_BCACHE( this );
+	BCACHE_BUFFER*	buffer;
+
+	if( sector >= this->numberOfSectors )
+		return -1;
+
+	buffer = bcache_find( cache, sector ); // 한 섹터 전체를 덮어쓰므로 miss여도 device에서 읽을 필요 없음
+	if( buffer == NULL )
+	{
+		buffer = bcache_get_buffer( cache, sector );
+		if( buffer == NULL )
+			return -1;
+	}
+
+	bcache_touch( cache, buffer );
+	memcpy( buffer->data, data, this->bytesPerSector );
+	buffer->dirty = 1;
+
+	return 0;
+}
+
+BYTE* bcache_next_address( BCACHE_CURSOR* cursor )
+{
+	BYTE*	address;
+
+	if( cursor->iov == NULL )
+	{
+		address = cursor->data;
+		cursor->data += cursor->bytesPerSector;
+		return address;
+	}
+
+	while( cursor->index < cursor->iovCount && cursor->used == cursor->iov[cursor->index].count )
+	{
+		cursor->index++;
+		cursor->used = 0;
+	}
+
+	if( cursor->index == cursor->iovCount )
+		return NULL;
+
+	address = ( BYTE* )cursor->iov[cursor->index].buffer + cursor->used * cursor->bytesPerSector;
+	cursor->used++;
+
+	return address;
+}
+
+void bcache_init_cursor( BCACHE_CURSOR* cursor, const void* data, const DISK_IOVEC* iov, int iovCount, UINT32 bytesPerSector )
+{
+	cursor->iov				= iov;
+	cursor->iovCount		= iovCount;
+	cursor->index			= 0;
+	cursor->used			= 0;
+	cursor->data			= ( BYTE* )data;
+	cursor->bytesPerSector	= bytesPerSector;
+}
+
+int bcache_issue_run( BCACHE* cache, BCACHE_RUN* run, int write )
+{
+	int	result = 0;
+
+	if( run->count == 0 )
+		return 0;
+
+	if( write )
+		result = cache->device->write_sectors( cache->device, run->start, run->count, NULL, run->iov, run->iovCount );
+	else
+		result = cache->device->read_sectors( cache->device, run->start, run->count, NULL, run->iov, run->iovCount );
+
+	run->count = 0;
+	run->iovCount = 0;
+
+	return result;
+}
+
+/* appends one sector to the run, merging it with the last iovec element when the memory is adjacent */
+int bcache_add_to_run( BCACHE* cache, BCACHE_RUN* run, SECTOR sector, BYTE* address, int write )
+{
+	DISK_IOVEC*	last = ( run->iovCount ? &run->iov[run->iovCount - 1] : NULL );
+
+	if( last && ( BYTE* )last->buffer + last->count * cache->disk.bytesPerSector == address )
+	{
+		last->count++;
+		run->count++;
+		return 0;
+	}
+
+	if( run->iovCount == BCACHE_RUN_MAX && bcache_issue_run( cache, run, write ) )
+		return -1;
+
+	if( run->count == 0 )
+		run->start = sector;
+
+	run->iov[run->iovCount].buffer	= address;
+	run->iov[run->iovCount].count	= 1;
+	run->iovCount++;
+	run->count++;
+
+	return 0;
+}
+
+/* cached sectors are served from the cache, the others are read from the device in runs */
+int bcache_read_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, void* data, const DISK_IOVEC* iov, int iovCount )
+{
+	BCACHE*			cache = TO_BCACHE( this );
+	BCACHE_BUFFER*	buffer;
+	BCACHE_CURSOR	cursor;
+	BCACHE_RUN		run;
+	BYTE*			address;
+	SECTOR			i;
+
+	if( sector >= this->numberOfSectors || count > this->numberOfSectors - sector )
+		return -1;
+
+	bcache_init_cursor( &cursor, data, iov, iovCount, this->bytesPerSector );
+	run.count = 0;
+	run.iovCount = 0;
+
+	for( i = 0; i < count; i++ )
+	{
+		address = bcache_next_address( &cursor );
+		if( address == NULL )
+			break;
+
+		buffer = bcache_find( cache, sector + i );
+		if( buffer )
+		{
+			if( bcache_issue_run( cache, &run, 0 ) ) // 캐시에 있는 섹터 앞까지의 run을 먼저 읽음
+				return -1;
+
+			bcache_touch( cache, buffer );
+			memcpy( address, buffer->data, this->bytesPerSector );
+		}
+		else if( bcache_add_to_run( cache, &run, sector + i, address, 0 ) )
+			return -1;
+	}
+
+	return bcache_issue_run( cache, &run, 0 );
+}
+
+/* large writes go straight to the device, cached copies of the sectors are kept up to date */
+int bcache_write_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, const void* data, const DISK_IOVEC* iov, int iovCount )
+{
+	BCACHE*			cache = TO_BCACHE( this );
+	BCACHE_BUFFER*	buffer;
+	BCACHE_CURSOR	cursor;
+	BCACHE_RUN		run;
+	BYTE*			address;
+	SECTOR			i, j;
+	int				result = 0;
+
+	if( sector >= this->numberOfSectors || count > this->numberOfSectors - sector )
+		return -1;
+
+	bcache_init_cursor( &cursor, data, iov, iovCount, this->bytesPerSector );
+	run.count = 0;
+	run.iovCount = 0;
+
+	for( i = 0; i < count; i++ )
+	{
+		address = bcache_next_address( &cursor );
+		if( address == NULL )
+			break;
+
+		if( bcache_add_to_run( cache, &run, sector + i, address, 1 ) )
+		{
+			result = -1;
+			break;
+		}
+
+		buffer = bcache_find( cache, sector + i );
+		if( buffer )
+			memcpy( buffer->data, address, this->bytesPerSector );
+	}
+
+	if( result == 0 )
+		result = bcache_issue_run( cache, &run, 1 );
+
+	for( j = 0; j < i; j++ )
+	{ // 캐시 사본은 device에 간 뒤에만 clean, 실패하면 dirty로 남겨 flush가 다시 write
+		buffer = bcache_find( cache, sector + j );
+		if( buffer )
+			buffer->dirty = ( result != 0 );
+	}
+
+	return result;
+}
+
+/* drops the buffers of a prefetch run which could not be read */
+void bcache_drop_buffers( BCACHE* cache, BCACHE_BUFFER** buffers, UINT32 count )
+{
+	while( count-- > 0 )
+		bcache_unhash( cache, buffers[count] );
+}
+
+/* Reads the sectors which are not cached yet into cache buffers, a run of them in one
+ * device call scattered into the buffers. At most half of the buffers are filled, so
+ * reading ahead does not push everything else out of the cache */
+int bcache_prefetch( BCACHE* cache, SECTOR sector, SECTOR count )
+{
+	BCACHE_BUFFER*	taken[BCACHE_RUN_MAX];
+	BCACHE_BUFFER*	buffer;
+	BCACHE_RUN		run;
+	UINT32			runBuffers = 0;
+	SECTOR			i;
+
+	if( sector >= cache->disk.numberOfSectors )
+		return -1;
+
+	if( count > cache->disk.numberOfSectors - sector )
+		count = cache->disk.numberOfSectors - sector;
+	if( count > cache->numberOfBuffers / 2 )
+		count = cache->numberOfBuffers / 2;
+	run.count = 0;
+	run.iovCount = 0;
+
+	for( i = 0; i < count; i++ )
+	{
+		if( bcache_find( cache, sector + i ) || runBuffers == BCACHE_RUN_MAX )
+		{ // 이미 캐시에 있으면 run을 끊음
+			if( bcache_issue_run( cache, &run, 0 ) )
+			{
+				bcache_drop_buffers( cache, taken, runBuffers );
+				return -1;
+			}
+			runBuffers = 0;
+
+			if( bcache_find( cache, sector + i ) )
+				continue;
+		}
+
+		buffer = bcache_get_buffer( cache, sector + i );
+		if( buffer == NULL )
+			break;
+
+		taken[runBuffers++] = buffer;
+		bcache_add_to_run( cache, &run, sector + i, buffer->data, 0 ); // iovec이 남아 있으므로 여기서 읽지 않음
+	}
+
+	if( bcache_issue_run( cache, &run, 0 ) )
+	{
+		bcache_drop_buffers( cache, taken, runBuffers );
+		return -1;
+	}
+
+	return 0;
+}
+
+/* writes a run of dirty buffers, they stay dirty if the write fails */
+int bcache_flush_run( BCACHE* cache, BCACHE_RUN* run, BCACHE_BUFFER** buffers, UINT32 count )
+{
+	if( bcache_issue_run( cache, run, 1 ) )
+		return -1;
+
+	while( count-- > 0 )
+		buffers[count]->dirty = 0;
+
+	return 0;
+}
+
+int bcache_compare_buffers( const void* a, const void* b )
+{
+	SECTOR	sectorA = ( *( BCACHE_BUFFER** )a )->sector;
+	SECTOR	sectorB = ( *( BCACHE_BUFFER** )b )->sector;
+
+	return ( sectorA > sectorB ) - ( sectorA < sectorB );
+}
+
+/* writes back every dirty buffer, sorted by sector so adjacent sectors go out in one call */
+int bcache_flush( BCACHE* cache )
+{
+	BCACHE_BUFFER**	dirty;
+	BCACHE_RUN		run;
+	UINT32			i, first, count = 0;
+	int				result = 0;
+
+	dirty = ( BCACHE_BUFFER** )malloc( cache->numberOfBuffers * sizeof( BCACHE_BUFFER* ) );
+	if( dirty == NULL )
+		return -1;
+
+	for( i = 0; i < cache->numberOfBuffers; i++ )
+	{
+		if( cache->buffers[i].valid && cache->buffers[i].dirty )
+			dirty[count++] = &cache->buffers[i];
+	}
+
+	qsort( dirty, count, sizeof( BCACHE_BUFFER* ), bcache_compare_buffers );
+
+	run.count = 0;
+	run.iovCount = 0;
+	for( i = 0, first = 0; i < count; i++ )
+	{
+		if( run.count && ( run.start + run.count != dirty[i]->sector || run.iovCount == BCACHE_RUN_MAX ) )
+		{ // 섹터가 이어지지 않거나 iovec이 가득 차면 지금까지를 write
+			result |= bcache_flush_run( cache, &run, &dirty[first], i - first );
+			first = i;
+		}
+
+		if( run.count == 0 )
+			run.start = dirty[i]->sector;
+
+		run.iov[run.iovCount].buffer = dirty[i]->data;
+		run.iov[run.iovCount].count = 1;
+		run.iovCount++;
+		run.count++;
+	}
+	result |= bcache_flush_run( cache, &run, &dirty[first], count - first );
+
+	free( dirty );
+
+	return ( result ? -1 : 0 );
+}
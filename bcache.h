@@ -0,0 +1,51 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : bcache.h                                                         */
+/* Notes   : Sector buffer cache header                                       */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef _BCACHE_H_
+#define _BCACHE_H_
+
+#include "common.h"
+#include "disk.h"
+
+#define BCACHE_DEFAULT_BUFFERS	64
+
+typedef struct BCACHE_BUFFER
+{
+	SECTOR					sector;
+	BYTE					valid;
+	BYTE					dirty;
+	BYTE*					data;
+
+	struct BCACHE_BUFFER*	hashNext;
+	struct BCACHE_BUFFER*	prev;		/* LRU list, head is the most recently used */
+	struct BCACHE_BUFFER*	next;
+} BCACHE_BUFFER;
+
+/* The cache is itself a DISK_OPERATIONS, so it can be stacked on any device.
+ * Buffers are keyed by physical sector and written back when evicted or flushed */
+typedef struct
+{
+	DISK_OPERATIONS		disk;			/* operations handed to the upper layer */
+	DISK_OPERATIONS*	device;			/* underlying device */
+
+	UINT32				numberOfBuffers;
+	UINT32				hashMask;
+	BCACHE_BUFFER*		buffers;
+	BCACHE_BUFFER**		hash;
+	BCACHE_BUFFER*		head;
+	BCACHE_BUFFER*		tail;
+	BYTE*				data;
+} BCACHE;
+
+int		bcache_init( BCACHE*, DISK_OPERATIONS*, UINT32 );
+int		bcache_flush( BCACHE* );
+int		bcache_prefetch( BCACHE*, SECTOR, SECTOR );
+void	bcache_uninit( BCACHE* );
+
+#endif
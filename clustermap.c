@@ -0,0 +1,226 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : clustermap.c                                                     */
+/* Notes   : Free cluster bitmap                                              */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include "common.h"
+#include "clustermap.h"
+
+#define WORD_INDEX( a )			( ( a ) / CLUSTERS_PER_WORD )
+#define BIT_MASK( a )			( ( UINT64 )1 << ( ( a ) % CLUSTERS_PER_WORD ) )
+#define MIN_CLUSTER( a, b )		( ( a ) < ( b ) ? ( a ) : ( b ) )
+
+#ifdef __GNUC__
+#define POPCOUNT64( a )			__builtin_popcountll( a )
+#define CTZ64( a )				__builtin_ctzll( a )
+#else
+UINT32 POPCOUNT64( UINT64 a )
+{
+	a = a - ( ( a >> 1 ) & 0x5555555555555555ULL );
+	a = ( a & 0x3333333333333333ULL ) + ( ( a >> 2 ) & 0x3333333333333333ULL );
+	a = ( a + ( a >> 4 ) ) & 0x0F0F0F0F0F0F0F0FULL;
+	return ( UINT32 )( ( a * 0x0101010101010101ULL ) >> 56 );
+}
+
+UINT32 CTZ64( UINT64 a )
+{
+	UINT32	count = 0;
+
+	while( !( a & 1 ) )
+	{
+		a >>= 1;
+		count++;
+	}
+
+	return count;
+}
+#endif
+
+int init_cluster_bitmap( CLUSTER_BITMAP* map, UINT32 numberOfClusters )
+{
+	if( map == NULL )
+		return FAT_ERROR;
+
+	ZeroMemory( map, sizeof( CLUSTER_BITMAP ) );
+
+	map->numberOfWords = WORD_INDEX( numberOfClusters + CLUSTERS_PER_WORD - 1 );
+	map->words = ( UINT64* )calloc( map->numberOfWords ? map->numberOfWords : 1, sizeof( UINT64 ) ); // 처음엔 모두 사용중
+	if( map->words == NULL )
+		return FAT_ERROR;
+
+	map->numberOfClusters = numberOfClusters;
+
+	return FAT_SUCCESS;
+}
+
+void release_cluster_bitmap( CLUSTER_BITMAP* map )
+{
+	if( map == NULL )
+		return;
+
+	free( map->words );
+	ZeroMemory( map, sizeof( CLUSTER_BITMAP ) );
+}
+
+void set_cluster_free( CLUSTER_BITMAP* map, UINT32 cluster )
+{
+	if( cluster >= map->numberOfClusters || ( map->words[WORD_INDEX( cluster )] & BIT_MASK( cluster ) ) )
+		return;
+
+	map->words[WORD_INDEX( cluster )] |= BIT_MASK( cluster );
+	map->freeCount++;
+}
+
+void set_cluster_used( CLUSTER_BITMAP* map, UINT32 cluster )
+{
+	if( cluster >= map->numberOfClusters || !( map->words[WORD_INDEX( cluster )] & BIT_MASK( cluster ) ) )
+		return;
+
+	map->words[WORD_INDEX( cluster )] &= ~BIT_MASK( cluster );
+	map->freeCount--;
+}
+
+int is_cluster_free( const CLUSTER_BITMAP* map, UINT32 cluster )
+{
+	if( cluster >= map->numberOfClusters )
+		return 0;
+
+	return ( map->words[WORD_INDEX( cluster )] & BIT_MASK( cluster ) ) != 0;
+}
+
+/* Sets the free bits of 'count' (up to 64) clusters from 'first' at once. freeCount
+ * is not maintained here, count_free_clusters() has to be called afterwards */
+void merge_free_bits( CLUSTER_BITMAP* map, UINT32 first, UINT64 bits, UINT32 count )
+{
+	UINT32	index = WORD_INDEX( first );
+	UINT32	shift = first % CLUSTERS_PER_WORD;
+
+	if( first >= map->numberOfClusters )
+		return;
+
+	if( count > map->numberOfClusters - first )
+		count = map->numberOfClusters - first;
+	if( count < CLUSTERS_PER_WORD )
+		bits &= ( ( UINT64 )1 << count ) - 1;
+
+	map->words[index] |= bits << shift;
+	if( shift && index + 1 < map->numberOfWords )
+		map->words[index + 1] |= bits >> ( CLUSTERS_PER_WORD - shift ); // 다음 word로 넘어간 bit
+}
+
+/* recounts the free clusters a word at a time */
+UINT32 count_free_clusters( CLUSTER_BITMAP* map )
+{
+	UINT32	i, count = 0;
+
+	for( i = 0; i < map->numberOfWords; i++ )
+		count += POPCOUNT64( map->words[i] );
+
+	map->freeCount = count;
+
+	return count;
+}
+
+/* the first free cluster at or after 'from', a word of 64 clusters is skipped at once */
+int find_free_from( const CLUSTER_BITMAP* map, UINT32 from, UINT32 to, UINT32* cluster )
+{
+	UINT32	index;
+	UINT64	word;
+
+	if( from >= to )
+		return FAT_ERROR;
+
+	index = WORD_INDEX( from );
+	word = map->words[index] & ~( BIT_MASK( from ) - 1 ); // from 앞쪽 bit는 제외
+
+	while( word == 0 )
+	{
+		if( ++index >= map->numberOfWords || index * CLUSTERS_PER_WORD >= to )
+			return FAT_ERROR;
+		word = map->words[index];
+	}
+
+	*cluster = index * CLUSTERS_PER_WORD + CTZ64( word );
+
+	return ( *cluster < to ? FAT_SUCCESS : FAT_ERROR );
+}
+
+/* the first used cluster at or after 'from', or 'to' */
+UINT32 find_used_from( const CLUSTER_BITMAP* map, UINT32 from, UINT32 to )
+{
+	UINT32	index;
+	UINT64	word;
+
+	if( from >= to )
+		return to;
+
+	index = WORD_INDEX( from );
+	word = ~map->words[index] & ~( BIT_MASK( from ) - 1 );
+
+	while( word == 0 )
+	{
+		if( ++index >= map->numberOfWords || index * CLUSTERS_PER_WORD >= to )
+			return to;
+		word = ~map->words[index];
+	}
+
+	return MIN_CLUSTER( index * CLUSTERS_PER_WORD + CTZ64( word ), to );
+}
+
+/* next-fit search starting at 'start', wrapping around once */
+int find_free_cluster( const CLUSTER_BITMAP* map, UINT32 start, UINT32* cluster )
+{
+	if( start >= map->numberOfClusters )
+		start = 0;
+
+	if( find_free_from( map, start, map->numberOfClusters, cluster ) == FAT_SUCCESS )
+		return FAT_SUCCESS;
+
+	return find_free_from( map, 0, start, cluster );
+}
+
+/* Finds 'count' contiguous free clusters searching from 'start' and wrapping around once.
+ * When there is no such run, the longest run found is returned and FAT_ERROR */
+int find_free_run( const CLUSTER_BITMAP* map, UINT32 count, UINT32 start, UINT32* first, UINT32* length )
+{
+	UINT32	pass, from, to, runStart, runEnd;
+	UINT32	bestStart = 0, bestLength = 0;
+
+	if( start >= map->numberOfClusters )
+		start = 0;
+
+	for( pass = 0; pass < 2; pass++ )
+	{
+		from	= ( pass == 0 ? start : 0 );
+		to		= ( pass == 0 ? map->numberOfClusters : start );
+
+		while( find_free_from( map, from, to, &runStart ) == FAT_SUCCESS )
+		{
+			runEnd = find_used_from( map, runStart, map->numberOfClusters );
+
+			if( runEnd - runStart >= count )
+			{
+				*first = runStart;
+				*length = count;
+				return FAT_SUCCESS;
+			}
+
+			if( runEnd - runStart > bestLength )
+			{
+				bestStart = runStart;
+				bestLength = runEnd - runStart;
+			}
+
+			from = runEnd;
+		}
+	}
+
+	*first = bestStart;
+	*length = bestLength;
+
+	return FAT_ERROR;
+}
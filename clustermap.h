@@ -0,0 +1,37 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : clustermap.h                                                     */
+/* Notes   : Free cluster bitmap header                                       */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef _CLUSTERMAP_H_
+#define _CLUSTERMAP_H_
+
+#include "common.h"
+
+#define CLUSTERS_PER_WORD		64
+
+/* one bit per cluster, a set bit means the cluster is free */
+typedef struct
+{
+	UINT64*		words;
+	UINT32		numberOfClusters;
+	UINT32		numberOfWords;
+	UINT32		freeCount;
+	UINT32		hint;			/* the next search starts here */
+} CLUSTER_BITMAP;
+
+int		init_cluster_bitmap( CLUSTER_BITMAP*, UINT32 );
+void	release_cluster_bitmap( CLUSTER_BITMAP* );
+void	set_cluster_free( CLUSTER_BITMAP*, UINT32 );
+void	set_cluster_used( CLUSTER_BITMAP*, UINT32 );
+int		is_cluster_free( const CLUSTER_BITMAP*, UINT32 );
+void	merge_free_bits( CLUSTER_BITMAP*, UINT32, UINT64, UINT32 );
+UINT32	count_free_clusters( CLUSTER_BITMAP* );
+int		find_free_cluster( const CLUSTER_BITMAP*, UINT32, UINT32* );
+int		find_free_run( const CLUSTER_BITMAP*, UINT32, UINT32, UINT32*, UINT32* );
+
+#endif
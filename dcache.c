@@ -0,0 +1,129 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : dcache.c                                                         */
+/* Notes   : Directory entry lookup cache                                     */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include <string.h>
+#include "fat.h"
+#include "dirindex.h"
+#include "dcache.h"
+
+FAT_DENTRY* get_dentry_set( FAT_DENTRY_CACHE* cache, DWORD parentCluster, const BYTE* name )
+{
+	UINT32	hash = hash_dir_name( name ) ^ ( parentCluster * 2654435761u );
+
+	return cache->sets[hash % DENTRY_CACHE_SETS];
+}
+
+void init_dentry_cache( FAT_DENTRY_CACHE* cache )
+{
+	ZeroMemory( cache, sizeof( FAT_DENTRY_CACHE ) );
+}
+
+/* returns the cached result of looking up the name in the directory, or NULL */
+FAT_DENTRY* lookup_dentry( FAT_DENTRY_CACHE* cache, DWORD parentCluster, const BYTE* name )
+{
+	FAT_DENTRY*	set = get_dentry_set( cache, parentCluster, name );
+	UINT32		i;
+
+	for( i = 0; i < DENTRY_CACHE_WAYS; i++ )
+	{
+		if( set[i].state != DENTRY_EMPTY && set[i].parentCluster == parentCluster &&
+			memcmp( set[i].name, name, MAX_ENTRY_NAME_LENGTH ) == 0 )
+		{
+			set[i].lastUsed = ++cache->clock;
+			return &set[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Caches a lookup result, 'node' is NULL if the name was not found. The least
+ * recently used entry of the set is replaced */
+void add_dentry( FAT_DENTRY_CACHE* cache, DWORD parentCluster, const BYTE* name, const FAT_NODE* node )
+{
+	FAT_DENTRY*	set = get_dentry_set( cache, parentCluster, name );
+	FAT_DENTRY*	victim = &set[0];
+	UINT32		i;
+
+	for( i = 0; i < DENTRY_CACHE_WAYS; i++ )
+	{
+		if( set[i].state != DENTRY_EMPTY && set[i].parentCluster == parentCluster &&
+			memcmp( set[i].name, name, MAX_ENTRY_NAME_LENGTH ) == 0 )
+		{
+			victim = &set[i]; // 같은 이름은 덮어씀
+			break;
+		}
+
+		if( set[i].lastUsed < victim->lastUsed )
+			victim = &set[i];
+	}
+
+	victim->parentCluster = parentCluster;
+	memcpy( victim->name, name, MAX_ENTRY_NAME_LENGTH );
+	if( node )
+	{
+		victim->state = DENTRY_POSITIVE;
+		victim->entry = node->entry;
+		victim->location = node->location;
+	}
+	else
+		victim->state = DENTRY_NEGATIVE;
+	victim->lastUsed = ++cache->clock;
+}
+
+/* forgets the name, e.g. because it was just created in the directory */
+void drop_dentry( FAT_DENTRY_CACHE* cache, DWORD parentCluster, const BYTE* name )
+{
+	FAT_DENTRY*	dentry = lookup_dentry( cache, parentCluster, name );
+
+	if( dentry )
+	{
+		dentry->state = DENTRY_EMPTY;
+		dentry->lastUsed = 0;
+	}
+}
+
+/* The entry at 'location' was overwritten with 'value'. A cached node of that entry
+ * takes the new contents if it keeps its name, otherwise it is dropped */
+void update_dentry_location( FAT_DENTRY_CACHE* cache, const FAT_ENTRY_LOCATION* location, const FAT_DIR_ENTRY* value )
+{
+	FAT_DENTRY*	dentry = &cache->sets[0][0];
+	UINT32		i;
+
+	for( i = 0; i < DENTRY_CACHE_SETS * DENTRY_CACHE_WAYS; i++, dentry++ )
+	{
+		if( dentry->state != DENTRY_POSITIVE || dentry->location.cluster != location->cluster ||
+			dentry->location.sector != location->sector || dentry->location.number != location->number )
+			continue;
+
+		if( memcmp( dentry->name, value->name, MAX_ENTRY_NAME_LENGTH ) == 0 )
+			dentry->entry = *value; // 크기, 첫 cluster 등이 바뀐 경우
+		else
+		{
+			dentry->state = DENTRY_EMPTY; // 지워졌거나 이름이 바뀜
+			dentry->lastUsed = 0;
+		}
+	}
+}
+
+/* drops every name cached for the directory, when it is removed or its cluster is reused */
+void purge_dentry_dir( FAT_DENTRY_CACHE* cache, DWORD parentCluster )
+{
+	FAT_DENTRY*	dentry = &cache->sets[0][0];
+	UINT32		i;
+
+	for( i = 0; i < DENTRY_CACHE_SETS * DENTRY_CACHE_WAYS; i++, dentry++ )
+	{
+		if( dentry->state != DENTRY_EMPTY && dentry->parentCluster == parentCluster )
+		{
+			dentry->state = DENTRY_EMPTY;
+			dentry->lastUsed = 0;
+		}
+	}
+}
@@ -0,0 +1,22 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : dcache.h                                                         */
+/* Notes   : Directory entry lookup cache header                              */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef _DCACHE_H_
+#define _DCACHE_H_
+
+#include "fat.h"
+
+void		init_dentry_cache( FAT_DENTRY_CACHE* );
+FAT_DENTRY*	lookup_dentry( FAT_DENTRY_CACHE*, DWORD, const BYTE* );
+void		add_dentry( FAT_DENTRY_CACHE*, DWORD, const BYTE*, const FAT_NODE* );
+void		drop_dentry( FAT_DENTRY_CACHE*, DWORD, const BYTE* );
+void		update_dentry_location( FAT_DENTRY_CACHE*, const FAT_ENTRY_LOCATION*, const FAT_DIR_ENTRY* );
+void		purge_dentry_dir( FAT_DENTRY_CACHE*, DWORD );
+
+#endif
@@ -0,0 +1,298 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : dirindex.c                                                       */
+/* Notes   : Directory name index                                             */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include <string.h>
+#include "common.h"
+#include "dirindex.h"
+
+#define DIR_INDEX_INITIAL_CAPACITY	64
+
+/* FNV-1a of the formatted name */
+UINT32 hash_dir_name( const BYTE* name )
+{
+	UINT32	hash = 2166136261u;
+	UINT32	i;
+
+	for( i = 0; i < DIR_INDEX_NAME_LENGTH; i++ )
+	{
+		hash ^= name[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+void init_dir_index_cache( DIR_INDEX_CACHE* cache )
+{
+	ZeroMemory( cache, sizeof( DIR_INDEX_CACHE ) );
+}
+
+void release_dir_index_cache( DIR_INDEX_CACHE* cache )
+{
+	UINT32	i;
+
+	for( i = 0; i < DIR_INDEX_DIRS; i++ )
+	{
+		free( cache->dirs[i].slots );
+		free( cache->dirs[i].holes );
+	}
+
+	ZeroMemory( cache, sizeof( DIR_INDEX_CACHE ) );
+}
+
+/* returns the index of the directory, or NULL if it is not built yet */
+DIR_INDEX* find_dir_index( DIR_INDEX_CACHE* cache, DWORD dirCluster )
+{
+	UINT32	i;
+
+	for( i = 0; i < DIR_INDEX_DIRS; i++ )
+	{
+		if( cache->dirs[i].loaded && cache->dirs[i].dirCluster == dirCluster )
+		{
+			cache->dirs[i].lastUsed = ++cache->clock;
+			return &cache->dirs[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* empties the least recently used index and keys it for the directory. The caller
+ * fills it and drops it with invalidate_dir_index if that fails */
+DIR_INDEX* new_dir_index( DIR_INDEX_CACHE* cache, DWORD dirCluster )
+{
+	DIR_INDEX*	victim = &cache->dirs[0];
+	UINT32		i;
+
+	invalidate_dir_index( cache, dirCluster );
+
+	for( i = 1; i < DIR_INDEX_DIRS; i++ )
+	{
+		if( cache->dirs[i].lastUsed < victim->lastUsed )
+			victim = &cache->dirs[i]; // 가장 오래전에 쓴 index
+	}
+
+	if( victim->slots )
+		ZeroMemory( victim->slots, victim->capacity * sizeof( DIR_INDEX_SLOT ) ); // 메모리는 재사용
+
+	victim->dirCluster	= dirCluster;
+	victim->loaded		= 1;
+	victim->count		= 0;
+	victim->lastUsed	= ++cache->clock;
+	victim->holeCount	= 0;
+	victim->hasEnd		= 0;
+
+	return victim;
+}
+
+/* drops the index of a directory which is removed or whose entries are not known any more */
+void invalidate_dir_index( DIR_INDEX_CACHE* cache, DWORD dirCluster )
+{
+	UINT32	i;
+
+	for( i = 0; i < DIR_INDEX_DIRS; i++ )
+	{
+		if( cache->dirs[i].loaded && cache->dirs[i].dirCluster == dirCluster )
+		{
+			cache->dirs[i].loaded = 0;
+			cache->dirs[i].count = 0;
+			cache->dirs[i].lastUsed = 0;
+			cache->dirs[i].holeCount = 0;
+			cache->dirs[i].hasEnd = 0;
+		}
+	}
+}
+
+/* returns the slot holding the name, or the empty slot where it would be inserted */
+DIR_INDEX_SLOT* probe_dir_index( const DIR_INDEX* index, const BYTE* name )
+{
+	UINT32	mask = index->capacity - 1;
+	UINT32	i = hash_dir_name( name ) & mask;
+
+	while( index->slots[i].name[0] != 0 && memcmp( index->slots[i].name, name, DIR_INDEX_NAME_LENGTH ) != 0 )
+		i = ( i + 1 ) & mask;
+
+	return &index->slots[i];
+}
+
+int grow_dir_index( DIR_INDEX* index )
+{
+	DIR_INDEX_SLOT*	oldSlots = index->slots;
+	UINT32			oldCapacity = index->capacity;
+	UINT32			capacity = ( oldCapacity ? oldCapacity * 2 : DIR_INDEX_INITIAL_CAPACITY );
+	UINT32			i;
+
+	index->slots = ( DIR_INDEX_SLOT* )calloc( capacity, sizeof( DIR_INDEX_SLOT ) );
+	if( index->slots == NULL )
+	{
+		index->slots = oldSlots;
+		return FAT_ERROR;
+	}
+	index->capacity = capacity;
+
+	for( i = 0; i < oldCapacity; i++ )
+	{
+		if( oldSlots[i].name[0] != 0 )
+			*probe_dir_index( index, oldSlots[i].name ) = oldSlots[i]; // 새 table에 다시 hash
+	}
+	free( oldSlots );
+
+	return FAT_SUCCESS;
+}
+
+/* Adds a name and the location of its entry. The first location of a name which is
+ * in the directory twice is kept, as the linear search finds that one */
+int insert_dir_index( DIR_INDEX* index, const BYTE* name, UINT32 cluster, UINT32 sector, INT32 number )
+{
+	DIR_INDEX_SLOT*	slot;
+
+	if( ( index->count + 1 ) * 4 > index->capacity * 3 && grow_dir_index( index ) ) // load factor 3/4
+		return FAT_ERROR;
+
+	slot = probe_dir_index( index, name );
+	if( slot->name[0] != 0 )
+		return FAT_SUCCESS;
+
+	memcpy( slot->name, name, DIR_INDEX_NAME_LENGTH );
+	slot->cluster	= cluster;
+	slot->sector	= sector;
+	slot->number	= number;
+	index->count++;
+
+	return FAT_SUCCESS;
+}
+
+DIR_INDEX_SLOT* lookup_dir_index( const DIR_INDEX* index, const BYTE* name )
+{
+	DIR_INDEX_SLOT*	slot;
+
+	if( index->capacity == 0 )
+		return NULL;
+
+	slot = probe_dir_index( index, name );
+
+	return ( slot->name[0] != 0 ? slot : NULL );
+}
+
+int remove_dir_index( DIR_INDEX* index, const BYTE* name )
+{
+	DIR_INDEX_SLOT*	slot = lookup_dir_index( index, name );
+	UINT32			mask = index->capacity - 1;
+	UINT32			hole, next, home;
+
+	if( slot == NULL )
+		return FAT_ERROR;
+
+	// 뒤따르는 slot들을 당겨서 probe 순서를 유지(tombstone 없음)
+	hole = ( UINT32 )( slot - index->slots );
+	next = hole;
+	for( ;; )
+	{
+		next = ( next + 1 ) & mask;
+		if( index->slots[next].name[0] == 0 )
+			break;
+
+		home = hash_dir_name( index->slots[next].name ) & mask;
+		if( hole <= next ? ( hole < home && home <= next ) : ( hole < home || home <= next ) )
+			continue; // home이 hole 뒤에 있으면 그대로 둠
+
+		index->slots[hole] = index->slots[next];
+		hole = next;
+	}
+
+	index->slots[hole].name[0] = 0;
+	index->count--;
+
+	return FAT_SUCCESS;
+}
+
+/* An entry at the given location changed its name from 'oldName' to 'newName', NULL if
+ * it was freed. Updates the index of whichever directory holds that entry, a freed
+ * entry becomes a hole of that directory */
+void rename_dir_index( DIR_INDEX_CACHE* cache, const BYTE* oldName, const BYTE* newName, UINT32 cluster, UINT32 sector, INT32 number )
+{
+	DIR_INDEX_SLOT*	slot;
+	UINT32			i;
+	int				result;
+
+	for( i = 0; i < DIR_INDEX_DIRS; i++ )
+	{
+		if( !cache->dirs[i].loaded )
+			continue;
+
+		slot = lookup_dir_index( &cache->dirs[i], oldName );
+		if( slot == NULL || slot->cluster != cluster || slot->sector != sector || slot->number != number )
+			continue; // 다른 디렉토리의 entry
+
+		remove_dir_index( &cache->dirs[i], oldName );
+		if( newName )
+			result = insert_dir_index( &cache->dirs[i], newName, cluster, sector, number );
+		else
+			result = push_dir_index_hole( &cache->dirs[i], cluster, sector, number ); // 지워진 entry는 다음 insert에 재사용
+
+		if( result )
+			invalidate_dir_index( cache, cache->dirs[i].dirCluster );
+	}
+}
+
+/* remembers a free entry of the directory, the last hole is the next one an insert uses */
+int push_dir_index_hole( DIR_INDEX* index, UINT32 cluster, UINT32 sector, INT32 number )
+{
+	DIR_INDEX_LOCATION*	holes;
+	UINT32				capacity;
+
+	if( index->holeCount == index->holeCapacity )
+	{
+		capacity = ( index->holeCapacity ? index->holeCapacity * 2 : DIR_INDEX_INITIAL_CAPACITY );
+		holes = ( DIR_INDEX_LOCATION* )realloc( index->holes, capacity * sizeof( DIR_INDEX_LOCATION ) );
+		if( holes == NULL )
+			return FAT_ERROR;
+
+		index->holes = holes;
+		index->holeCapacity = capacity;
+	}
+
+	index->holes[index->holeCount].cluster	= cluster;
+	index->holes[index->holeCount].sector	= sector;
+	index->holes[index->holeCount].number	= number;
+	index->holeCount++;
+
+	return FAT_SUCCESS;
+}
+
+/* forgets a free entry which is used now. It is the last one unless the slots of the
+ * insert did not come from this index */
+void take_dir_index_hole( DIR_INDEX* index, UINT32 cluster, UINT32 sector, INT32 number )
+{
+	UINT32	i = index->holeCount;
+
+	while( i-- > 0 )
+	{
+		if( index->holes[i].cluster == cluster && index->holes[i].sector == sector && index->holes[i].number == number )
+		{
+			memmove( &index->holes[i], &index->holes[i + 1], ( index->holeCount - i - 1 ) * sizeof( DIR_INDEX_LOCATION ) );
+			index->holeCount--;
+			return;
+		}
+	}
+}
+
+/* holes are pushed in directory order while the index is built, so the first one is used first */
+void reverse_dir_index_holes( DIR_INDEX* index )
+{
+	DIR_INDEX_LOCATION	hole;
+	UINT32				i;
+
+	for( i = 0; i < index->holeCount / 2; i++ )
+	{
+		hole = index->holes[i];
+		index->holes[i] = index->holes[index->holeCount - 1 - i];
+		index->holes[index->holeCount - 1 - i] = hole;
+	}
+}
@@ -0,0 +1,72 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : dirindex.h                                                       */
+/* Notes   : Directory name index header                                      */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef _DIRINDEX_H_
+#define _DIRINDEX_H_
+
+#include "common.h"
+
+#define DIR_INDEX_DIRS			8		/* directories whose name indexes are kept per file system */
+#define DIR_INDEX_NAME_LENGTH	11		/* formatted 8.3 name */
+
+/* an entry location, same fields as FAT_ENTRY_LOCATION */
+typedef struct
+{
+	UINT32	cluster;
+	UINT32	sector;
+	INT32	number;
+} DIR_INDEX_LOCATION;
+
+/* where the entry of a name is, same fields as FAT_ENTRY_LOCATION */
+typedef struct
+{
+	BYTE	name[DIR_INDEX_NAME_LENGTH];	/* name[0] == 0 if the slot is empty */
+	UINT32	cluster;
+	UINT32	sector;
+	INT32	number;
+} DIR_INDEX_SLOT;
+
+/* open addressing hash table of the names in one directory */
+typedef struct
+{
+	DWORD			dirCluster;		/* first cluster of the directory, 0 for the FAT12/16 root */
+	BYTE			loaded;			/* 0 if the index is not used */
+	UINT32			count;
+	UINT32			capacity;		/* power of 2 */
+	DIR_INDEX_SLOT*	slots;
+	UINT32			lastUsed;
+
+	DIR_INDEX_LOCATION*	holes;		/* free entries before the end marker, the next one to use is last */
+	UINT32				holeCount;
+	UINT32				holeCapacity;
+	BYTE				hasEnd;		/* 'end' is the DIR_ENTRY_NO_MORE entry */
+	DIR_INDEX_LOCATION	end;
+} DIR_INDEX;
+
+typedef struct
+{
+	DIR_INDEX	dirs[DIR_INDEX_DIRS];
+	UINT32		clock;
+} DIR_INDEX_CACHE;
+
+UINT32			hash_dir_name( const BYTE* );
+void			init_dir_index_cache( DIR_INDEX_CACHE* );
+void			release_dir_index_cache( DIR_INDEX_CACHE* );
+DIR_INDEX*		find_dir_index( DIR_INDEX_CACHE*, DWORD );
+DIR_INDEX*		new_dir_index( DIR_INDEX_CACHE*, DWORD );
+void			invalidate_dir_index( DIR_INDEX_CACHE*, DWORD );
+int				insert_dir_index( DIR_INDEX*, const BYTE*, UINT32, UINT32, INT32 );
+DIR_INDEX_SLOT*	lookup_dir_index( const DIR_INDEX*, const BYTE* );
+int				remove_dir_index( DIR_INDEX*, const BYTE* );
+void			rename_dir_index( DIR_INDEX_CACHE*, const BYTE*, const BYTE*, UINT32, UINT32, INT32 );
+int				push_dir_index_hole( DIR_INDEX*, UINT32, UINT32, INT32 );
+void			take_dir_index_hole( DIR_INDEX*, UINT32, UINT32, INT32 );
+void			reverse_dir_index_holes( DIR_INDEX* );
+
+#endif
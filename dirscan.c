@@ -0,0 +1,101 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : dirscan.c                                                        */
+/* Notes   : Directory sector scan kernel                                     */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include <string.h>
+#include "fat.h"
+#include "dirscan.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define DIR_NAME_BITS		0x7FF		/* the 11 name bytes of a 16 byte compare */
+
+void scan_dir_sector( const BYTE* sector, UINT32 count, const BYTE* name, DIR_SCAN_MASKS* masks )
+{
+	UINT32	freeMask = 0, endMask = 0, matchMask = 0;
+	UINT32	i = 0;
+
+	if( count > DIR_SCAN_ENTRIES )
+		count = DIR_SCAN_ENTRIES;
+
+#ifdef __SSE2__
+	/* The state is the first name byte. An unpack tree gathers it from 16 entries into
+	 * one vector, so each state of the 16 entries is found with one compare */
+	for( ; i + 16 <= count; i += 16 )
+	{
+		__m128i	v[16];
+		UINT32	k;
+
+		for( k = 0; k < 16; k++ )
+			v[k] = _mm_loadu_si128( ( const __m128i* )( sector + ( i + k ) * 32 ) );
+		for( k = 0; k < 16; k += 2 )
+			v[k / 2] = _mm_unpacklo_epi8( v[k], v[k + 1] );		// 첫 byte 2개씩
+		for( k = 0; k < 8; k += 2 )
+			v[k / 2] = _mm_unpacklo_epi16( v[k], v[k + 1] );	// 4개씩
+		for( k = 0; k < 4; k += 2 )
+			v[k / 2] = _mm_unpacklo_epi32( v[k], v[k + 1] );	// 8개씩
+		v[0] = _mm_unpacklo_epi64( v[0], v[1] );				// 16 entry의 첫 byte
+
+		freeMask	|= ( UINT32 )_mm_movemask_epi8( _mm_cmpeq_epi8( v[0], _mm_set1_epi8( ( char )DIR_ENTRY_FREE ) ) ) << i;
+		endMask		|= ( UINT32 )_mm_movemask_epi8( _mm_cmpeq_epi8( v[0], _mm_setzero_si128() ) ) << i;
+	}
+#endif
+	/* the rest one entry at a time, both tests are folded into the masks without branches */
+	for( ; i < count; i++ )
+	{
+		freeMask	|= ( UINT32 )( sector[i * 32] == DIR_ENTRY_FREE ) << i;
+		endMask		|= ( UINT32 )( sector[i * 32] == DIR_ENTRY_NO_MORE ) << i;
+	}
+
+	if( name )
+	{
+		i = 0;
+#ifdef __SSE2__
+		{
+			BYTE	padded[16] = { 0, };
+			__m128i	key;
+
+			memcpy( padded, name, MAX_ENTRY_NAME_LENGTH );
+			key = _mm_loadu_si128( ( const __m128i* )padded );
+
+			/* one 16 byte compare per entry, only the 11 name bytes have to be equal */
+			for( ; i < count; i++ )
+			{
+				UINT32	equal = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( ( const __m128i* )( sector + i * 32 ) ), key ) );
+
+				matchMask |= ( UINT32 )( ( equal & DIR_NAME_BITS ) == DIR_NAME_BITS ) << i;
+			}
+		}
+#endif
+		for( ; i < count; i++ )
+			matchMask |= ( UINT32 )( memcmp( sector + i * 32, name, MAX_ENTRY_NAME_LENGTH ) == 0 ) << i;
+	}
+
+	masks->freeMask		= freeMask;
+	masks->endMask		= endMask;
+	masks->matchMask	= matchMask;
+}
+
+UINT32 lowest_dir_bit( UINT32 mask )
+{
+#if defined( __GNUC__ )
+	return __builtin_ctz( mask );
+#else
+	UINT32	bit = 0;
+
+	while( !( mask & 1 ) )
+	{
+		mask >>= 1;
+		bit++;
+	}
+
+	return bit;
+#endif
+}
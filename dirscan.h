@@ -0,0 +1,37 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : dirscan.h                                                        */
+/* Notes   : Directory sector scan kernel header                              */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef _DIRSCAN_H_
+#define _DIRSCAN_H_
+
+#include "common.h"
+
+#define DIR_SCAN_ENTRIES		32		/* entries one kernel call classifies at most, one bit each */
+
+/* the entries of a directory sector by kind, bit i for entry i */
+typedef struct
+{
+	UINT32	freeMask;		/* name[0] is DIR_ENTRY_FREE */
+	UINT32	endMask;		/* name[0] is DIR_ENTRY_NO_MORE */
+	UINT32	matchMask;		/* the 11 byte name is the one searched for */
+} DIR_SCAN_MASKS;
+
+/*
+ * Classifies the first 'count' 32 byte entries of 'sector'. 'name' is a formatted
+ * 11 byte name, or NULL to leave matchMask empty.
+ */
+void	scan_dir_sector( const BYTE* sector, UINT32 count, const BYTE* name, DIR_SCAN_MASKS* masks );
+UINT32	lowest_dir_bit( UINT32 mask );
+
+/* bits of the entries before the first end marker, or 'all' if there is none */
+#define DIR_BEFORE_END( masks, all )	( ( masks ).endMask ? ( ( masks ).endMask & ( 0u - ( masks ).endMask ) ) - 1 : ( all ) )
+/* bits of the first 'count' entries */
+#define DIR_ALL_ENTRIES( count )		( ( count ) >= 32 ? 0xFFFFFFFFu : ( 1u << ( count ) ) - 1 )
+
+#endif
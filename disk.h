@@ -14,10 +14,20 @@
 
 #include "common.h"
 
+/* one element of a scatter/gather list, count is in sectors */
+typedef struct
+{
+	void*	buffer;
+	SECTOR	count;
+} DISK_IOVEC;
+
 typedef struct DISK_OPERATIONS
 {
 	int		( *read_sector	)( struct DISK_OPERATIONS*, SECTOR, void* ); //한 섹터 내용 data에 복사
 	int		( *write_sector	)( struct DISK_OPERATIONS*, SECTOR, const void* ); // 한 섹터에 data내용 복사
+	/* start sector, number of sectors, contiguous buffer or NULL, iovec list or NULL, iovec count */
+	int		( *read_sectors	)( struct DISK_OPERATIONS*, SECTOR, SECTOR, void*, const DISK_IOVEC*, int );
+	int		( *write_sectors )( struct DISK_OPERATIONS*, SECTOR, SECTOR, const void*, const DISK_IOVEC*, int );
 	SECTOR	numberOfSectors;
 	int		bytesPerSector;
 	void*	pdata;
@@ -0,0 +1,182 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : diskimg.c                                                        */
+/* Notes   : File-backed disk image                                           */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include <stdlib.h>
+#include <memory.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "disk.h"
+#include "diskimg.h"
+
+typedef struct
+{
+	int		fd;
+	char*	address;
+	size_t	length;
+} DISK_IMAGE;
+
+int diskimg_read( DISK_OPERATIONS* this, SECTOR sector, void* data );
+int diskimg_write( DISK_OPERATIONS* this, SECTOR sector, const void* data );
+int diskimg_read_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, void* data, const DISK_IOVEC* iov, int iovCount );
+int diskimg_write_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, const void* data, const DISK_IOVEC* iov, int iovCount );
+
+/* An existing image keeps its own size, a new one is created sparse with numberOfSectors */
+int diskimg_init( const char* path, SECTOR numberOfSectors, unsigned int bytesPerSector, DISK_OPERATIONS* disk )
+{
+	DISK_IMAGE*	image;
+	struct stat	st;
+
+	if( disk == NULL || path == NULL )
+		return -1;
+
+	image = ( DISK_IMAGE* )malloc( sizeof( DISK_IMAGE ) );
+	if( image == NULL )
+		return -1;
+
+	image->fd = open( path, O_RDWR | O_CREAT, 0644 );
+	if( image->fd < 0 )
+	{
+		free( image );
+		return -1;
+	}
+
+	if( fstat( image->fd, &st ) < 0 )
+		goto failed;
+
+	if( st.st_size % bytesPerSector )
+	{ // 마지막 sector 일부를 버리지 않도록 거부
+		WARNING( "%s: image size %lld is not a multiple of %u bytes\n", path, ( long long )st.st_size, bytesPerSector );
+		goto failed;
+	}
+	if( st.st_size == 0 && numberOfSectors == 0 )
+	{
+		WARNING( "%s: a new image needs a number of sectors\n", path );
+		goto failed;
+	}
+
+	if( st.st_size >= bytesPerSector )
+		numberOfSectors = st.st_size / bytesPerSector; // 기존 이미지는 파일 크기 그대로 사용
+	else if( ftruncate( image->fd, ( off_t )numberOfSectors * bytesPerSector ) < 0 )
+		goto failed;
+
+	image->length = ( size_t )numberOfSectors * bytesPerSector;
+	image->address = mmap( NULL, image->length, PROT_READ | PROT_WRITE, MAP_SHARED, image->fd, 0 );
+	if( image->address == MAP_FAILED )
+		goto failed;
+
+	disk->pdata				= image;
+	disk->read_sector		= diskimg_read;
+	disk->write_sector		= diskimg_write;
+	disk->read_sectors		= diskimg_read_sectors;
+	disk->write_sectors		= diskimg_write_sectors;
+	disk->numberOfSectors	= numberOfSectors;
+	disk->bytesPerSector	= bytesPerSector;
+
+	return 0;
+
+failed:
+	close( image->fd );
+	free( image );
+	return -1;
+}
+
+void diskimg_uninit( DISK_OPERATIONS* this ) // page cache 내용을 파일에 반영하고 해제
+{
+	DISK_IMAGE*	image;
+
+	if( this == NULL || this->pdata == NULL )
+		return;
+
+	image = ( DISK_IMAGE* )this->pdata;
+
+	msync( image->address, image->length, MS_SYNC );
+	munmap( image->address, image->length );
+	close( image->fd );
+
+	free( image );
+	this->pdata = NULL;
+}
+
+int diskimg_read( DISK_OPERATIONS* this, SECTOR sector, void* data )
+{
+	char* disk = ( ( DISK_IMAGE* )this->pdata )->address;
+
+	if( sector >= this->numberOfSectors )
+		return -1;
+
+	memcpy( data, &disk[( size_t )sector * this->bytesPerSector], this->bytesPerSector );
+
+	return 0;
+}
+
+int diskimg_write( DISK_OPERATIONS* this, SECTOR sector, const void* data )
+{
+	char* disk = ( ( DISK_IMAGE* )this->pdata )->address;
+
+	if( sector >= this->numberOfSectors )
+		return -1;
+
+	memcpy( &disk[( size_t )sector * this->bytesPerSector], data, this->bytesPerSector );
+
+	return 0;
+}
+
+int diskimg_read_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, void* data, const DISK_IOVEC* iov, int iovCount )
+{
+	char*	disk = ( ( DISK_IMAGE* )this->pdata )->address;
+	SECTOR	n;
+	int		i;
+
+	if( sector >= this->numberOfSectors || count > this->numberOfSectors - sector )
+		return -1;
+
+	if( iov == NULL ) // 연속된 버퍼 하나로 count개 섹터 복사
+	{
+		memcpy( data, &disk[( size_t )sector * this->bytesPerSector], ( size_t )count * this->bytesPerSector );
+		return 0;
+	}
+
+	for( i = 0; i < iovCount && count > 0; i++ ) // iovec 목록의 버퍼들에 나눠서 복사
+	{
+		n = ( iov[i].count < count ? iov[i].count : count );
+		memcpy( iov[i].buffer, &disk[( size_t )sector * this->bytesPerSector], ( size_t )n * this->bytesPerSector );
+		sector += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
+int diskimg_write_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, const void* data, const DISK_IOVEC* iov, int iovCount )
+{
+	char*	disk = ( ( DISK_IMAGE* )this->pdata )->address;
+	SECTOR	n;
+	int		i;
+
+	if( sector >= this->numberOfSectors || count > this->numberOfSectors - sector )
+		return -1;
+
+	if( iov == NULL )
+	{
+		memcpy( &disk[( size_t )sector * this->bytesPerSector], data, ( size_t )count * this->bytesPerSector );
+		return 0;
+	}
+
+	for( i = 0; i < iovCount && count > 0; i++ )
+	{
+		n = ( iov[i].count < count ? iov[i].count : count );
+		memcpy( &disk[( size_t )sector * this->bytesPerSector], iov[i].buffer, ( size_t )n * this->bytesPerSector );
+		sector += n;
+		count -= n;
+	}
+
+	return 0;
+}
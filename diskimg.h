@@ -0,0 +1,19 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : diskimg.h                                                        */
+/* Notes   : File-backed disk image header                                    */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+//diskimg = 호스트 파일을 mmap해서 쓰는 디스크
+#ifndef _DISKIMG_H_
+#define _DISKIMG_H_
+
+#include "common.h"
+#include "disk.h"
+
+int diskimg_init( const char*, SECTOR, unsigned int, DISK_OPERATIONS* );
+void diskimg_uninit( DISK_OPERATIONS* );
+
+#endif
@@ -22,6 +22,8 @@ typedef struct
 
 int disksim_read( DISK_OPERATIONS* this, SECTOR sector, void* data );
 int disksim_write( DISK_OPERATIONS* this, SECTOR sector, const void* data );
+int disksim_read_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, void* data, const DISK_IOVEC* iov, int iovCount );
+int disksim_write_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, const void* data, const DISK_IOVEC* iov, int iovCount );
 
 int disksim_init( SECTOR numberOfSectors, unsigned int bytesPerSector, DISK_OPERATIONS* disk ) 
 {	// pdata에 main에서 요청한 disk 크기 만큼 할당해서 연결
@@ -47,6 +49,8 @@ int disksim_init( SECTOR numberOfSectors, unsigned int bytesPerSector, DISK_OPER
 
 	
 	disk->write_sector	= disksim_write;
+	disk->read_sectors	= disksim_read_sectors;
+	disk->write_sectors	= disksim_write_sectors;
 	disk->numberOfSectors	= numberOfSectors;
 	disk->bytesPerSector	= bytesPerSector;
 	//메인에서의 DISK_OPERATIONS 즉, g_disk에 함수 및 디스크 크기 등록
@@ -85,3 +89,54 @@ int disksim_write( DISK_OPERATIONS* this, SECTOR sector, const void* data )
 	return 0;
 }
 
+int disksim_read_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, void* data, const DISK_IOVEC* iov, int iovCount )
+{
+	char*	disk = ( ( DISK_MEMORY* )this->pdata )->address;
+	SECTOR	n;
+	int		i;
+
+	if( sector >= this->numberOfSectors || count > this->numberOfSectors - sector )
+		return -1;
+
+	if( iov == NULL ) // 연속된 버퍼 하나로 count개 섹터 복사
+	{
+		memcpy( data, &disk[sector * this->bytesPerSector], ( size_t )count * this->bytesPerSector );
+		return 0;
+	}
+
+	for( i = 0; i < iovCount && count > 0; i++ ) // iovec 목록의 버퍼들에 나눠서 복사
+	{
+		n = ( iov[i].count < count ? iov[i].count : count );
+		memcpy( iov[i].buffer, &disk[sector * this->bytesPerSector], ( size_t )n * this->bytesPerSector );
+		sector += n;
+		count -= n;
+	}
+
+	return 0;
+}
+
+int disksim_write_sectors( DISK_OPERATIONS* this, SECTOR sector, SECTOR count, const void* data, const DISK_IOVEC* iov, int iovCount )
+{
+	char*	disk = ( ( DISK_MEMORY* )this->pdata )->address;
+	SECTOR	n;
+	int		i;
+
+	if( sector >= this->numberOfSectors || count > this->numberOfSectors - sector )
+		return -1;
+
+	if( iov == NULL )
+	{
+		memcpy( &disk[sector * this->bytesPerSector], data, ( size_t )count * this->bytesPerSector );
+		return 0;
+	}
+
+	for( i = 0; i < iovCount && count > 0; i++ )
+	{
+		n = ( iov[i].count < count ? iov[i].count : count );
+		memcpy( &disk[sector * this->bytesPerSector], iov[i].buffer, ( size_t )n * this->bytesPerSector );
+		sector += n;
+		count -= n;
+	}
+
+	return 0;
+}
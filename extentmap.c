@@ -0,0 +1,137 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : extentmap.c                                                      */
+/* Notes   : Cluster extent map                                               */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include "common.h"
+#include "extentmap.h"
+
+#define EXTENT_INITIAL_CAPACITY		4
+
+void init_extent_cache( EXTENT_CACHE* cache )
+{
+	ZeroMemory( cache, sizeof( EXTENT_CACHE ) );
+}
+
+void release_extent_cache( EXTENT_CACHE* cache )
+{
+	UINT32	i;
+
+	for( i = 0; i < EXTENT_CACHE_FILES; i++ )
+		free( cache->maps[i].extents );
+
+	ZeroMemory( cache, sizeof( EXTENT_CACHE ) );
+}
+
+/* Returns the map of the chain starting at 'firstCluster'. When it is not cached,
+ * the least recently used slot is emptied and keyed for the chain */
+EXTENT_MAP* get_extent_map( EXTENT_CACHE* cache, DWORD firstCluster )
+{
+	EXTENT_MAP*	victim = &cache->maps[0];
+	UINT32		i;
+
+	for( i = 0; i < EXTENT_CACHE_FILES; i++ )
+	{
+		if( cache->maps[i].firstCluster == firstCluster )
+		{
+			cache->maps[i].lastUsed = ++cache->clock;
+			return &cache->maps[i];
+		}
+
+		if( cache->maps[i].lastUsed < victim->lastUsed )
+			victim = &cache->maps[i]; // 가장 오래전에 쓴 slot
+	}
+
+	victim->firstCluster	= firstCluster;
+	victim->clusters		= 0;
+	victim->count			= 0;
+	victim->lastUsed		= ++cache->clock;
+
+	return victim;
+}
+
+/* drops the map of a chain which is freed or newly allocated */
+void invalidate_extent_map( EXTENT_CACHE* cache, DWORD firstCluster )
+{
+	UINT32	i;
+
+	for( i = 0; i < EXTENT_CACHE_FILES; i++ )
+	{
+		if( cache->maps[i].firstCluster == firstCluster )
+		{
+			cache->maps[i].firstCluster = 0;
+			cache->maps[i].clusters = 0;
+			cache->maps[i].count = 0;
+			cache->maps[i].lastUsed = 0;
+		}
+	}
+}
+
+/* appends the next 'length' contiguous clusters of the chain, merging them into the last run if it is adjacent */
+int append_extent_run( EXTENT_MAP* map, DWORD cluster, DWORD length )
+{
+	FAT_EXTENT*	last = ( map->count ? &map->extents[map->count - 1] : NULL );
+
+	if( last && last->physical + last->length == cluster )
+	{
+		last->length += length;
+		map->clusters += length;
+		return FAT_SUCCESS;
+	}
+
+	if( map->count == map->capacity )
+	{
+		UINT32		capacity = ( map->capacity ? map->capacity * 2 : EXTENT_INITIAL_CAPACITY );
+		FAT_EXTENT*	extents = ( FAT_EXTENT* )realloc( map->extents, capacity * sizeof( FAT_EXTENT ) );
+
+		if( extents == NULL )
+			return FAT_ERROR;
+
+		map->extents = extents;
+		map->capacity = capacity;
+	}
+
+	map->extents[map->count].logical	= map->clusters;
+	map->extents[map->count].physical	= cluster;
+	map->extents[map->count].length		= length;
+	map->count++;
+	map->clusters += length;
+
+	return FAT_SUCCESS;
+}
+
+DWORD get_extent_last_cluster( const EXTENT_MAP* map )
+{
+	const FAT_EXTENT*	last = &map->extents[map->count - 1];
+
+	return last->physical + last->length - 1;
+}
+
+/* Binary search for the run holding the 'index'th cluster. 'run' receives the number
+ * of mapped clusters which follow contiguously from it, including itself */
+int lookup_extent( const EXTENT_MAP* map, DWORD index, DWORD* cluster, DWORD* run )
+{
+	UINT32	low = 0, high = map->count, mid;
+
+	if( index >= map->clusters )
+		return FAT_ERROR;
+
+	while( high - low > 1 )
+	{
+		mid = ( low + high ) / 2;
+		if( map->extents[mid].logical <= index )
+			low = mid;
+		else
+			high = mid;
+	}
+
+	*cluster = map->extents[low].physical + ( index - map->extents[low].logical );
+	if( run )
+		*run = map->extents[low].length - ( index - map->extents[low].logical );
+
+	return FAT_SUCCESS;
+}
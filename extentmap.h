@@ -0,0 +1,50 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : extentmap.h                                                      */
+/* Notes   : Cluster extent map header                                        */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef _EXTENTMAP_H_
+#define _EXTENTMAP_H_
+
+#include "common.h"
+
+#define EXTENT_CACHE_FILES		8		/* chains whose extent maps are kept per file system */
+
+/* 'length' clusters of a chain which are physically contiguous */
+typedef struct
+{
+	DWORD	logical;		/* index of the first cluster in the chain */
+	DWORD	physical;		/* cluster number on the disk */
+	DWORD	length;
+} FAT_EXTENT;
+
+/* the part of a chain walked so far, as sorted runs */
+typedef struct
+{
+	DWORD		firstCluster;	/* key of the map, 0 if the slot is not used */
+	DWORD		clusters;		/* clusters mapped */
+	UINT32		count;
+	UINT32		capacity;
+	FAT_EXTENT*	extents;
+	UINT32		lastUsed;
+} EXTENT_MAP;
+
+typedef struct
+{
+	EXTENT_MAP	maps[EXTENT_CACHE_FILES];
+	UINT32		clock;
+} EXTENT_CACHE;
+
+void		init_extent_cache( EXTENT_CACHE* );
+void		release_extent_cache( EXTENT_CACHE* );
+EXTENT_MAP*	get_extent_map( EXTENT_CACHE*, DWORD );
+void		invalidate_extent_map( EXTENT_CACHE*, DWORD );
+int			append_extent_run( EXTENT_MAP*, DWORD, DWORD );
+DWORD		get_extent_last_cluster( const EXTENT_MAP* );
+int			lookup_extent( const EXTENT_MAP*, DWORD, DWORD*, DWORD* );
+
+#endif
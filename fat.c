@@ -10,16 +10,25 @@
 /******************************************************************************/
 
 #include "fat.h"
-#include "clusterlist.h"
+#include "clustermap.h"
+#include "fatscan.h"
+#include "dirscan.h"
+#include "dcache.h"
 
 #define MIN( a, b )					( ( a ) < ( b ) ? ( a ) : ( b ) )
 #define MAX( a, b )					( ( a ) > ( b ) ? ( a ) : ( b ) )
 #define NO_MORE_CLUSER()			WARNING( "No more clusters are remained\n" );
 
+#define CLEAR_FAT_SECTORS			64		/* sectors per write_sectors call while clearing the FAT	*/
+#define FLUSH_FAT_SECTORS			16		/* dirty FAT sectors per write_sectors call					*/
+#define LOAD_FAT_SECTORS			48		/* FAT sectors per read_sectors call at mount, a multiple of 3	*/
+
 unsigned char toupper( unsigned char ch );
 int isalpha( unsigned char ch );
 int isdigit( unsigned char ch );
 
+int prepare_fat( FAT_FILESYSTEM* fs );
+
 /* calculate the 'sectors per cluster' by some conditions */
 DWORD get_sector_per_clusterN( DWORD diskTable[][2], UINT64 diskSize, UINT32 bytesPerSector )
 {
@@ -269,6 +278,7 @@ int clear_fat( DISK_OPERATIONS* disk, FAT_BPB* bpb )
 	UINT32	FATSize;
 	SECTOR	fatSector;
 	BYTE	sector[MAX_SECTOR_SIZE];
+	DISK_IOVEC	iov[CLEAR_FAT_SECTORS];
 
 	ZeroMemory( sector, sizeof( sector ) ); // sector배열 0으로 초기화
 	fatSector = bpb->reservedSectorCount;
@@ -293,13 +303,36 @@ int clear_fat( DISK_OPERATIONS* disk, FAT_BPB* bpb )
 	ZeroMemory( sector, sizeof( sector ) );
 	// sector 다시 0으로 초기화
 
-	for( i = fatSector + 1; i < end; i++ )
-		disk->write_sector( disk, i, sector );
+	for( i = 0; i < CLEAR_FAT_SECTORS; i++ )
+	{
+		iov[i].buffer = sector;
+		iov[i].count = 1;
+	}
+	// 모든 iovec이 같은 0 섹터를 가리키므로 큰 버퍼 없이 여러 섹터를 한번에 write
+
+	for( i = fatSector + 1; i < end; i += CLEAR_FAT_SECTORS )
+		disk->write_sectors( disk, i, MIN( CLEAR_FAT_SECTORS, end - i ), NULL, iov, CLEAR_FAT_SECTORS );
 	// 위에서 write한 영역을 제외한 나머지 FAT영역을 free상태로 초기화
 
 	return FAT_SUCCESS;
 }
 
+/* writes an FSInfo sector whose counts are unknown, the first mount scans the FAT */
+int create_fsinfo( DISK_OPERATIONS* disk, FAT_BPB* bpb )
+{
+	BYTE		sector[MAX_SECTOR_SIZE];
+	FAT_FSINFO*	info = ( FAT_FSINFO* )sector;
+
+	ZeroMemory( sector, MAX_SECTOR_SIZE );
+	info->leadSignature		= FSINFO_LEAD_SIGNATURE;
+	info->structSignature	= FSINFO_STRUCT_SIGNATURE;
+	info->freeCount			= FSINFO_UNKNOWN;
+	info->nextFree			= FSINFO_UNKNOWN;
+	info->trailSignature	= FSINFO_TRAIL_SIGNATURE;
+
+	return disk->write_sector( disk, bpb->BPB32.FSInfo, sector );
+}
+
 int create_root( DISK_OPERATIONS* disk, FAT_BPB* bpb )
 {
 	BYTE	sector[MAX_SECTOR_SIZE];
@@ -335,22 +368,7 @@ int get_fat_sector( FAT_FILESYSTEM* fs, SECTOR cluster, SECTOR* fatSector, DWORD
 {
 	DWORD	fatOffset;
 
-	switch( fs->FATType )
-	{//파일 시스템에 맞게 fatOffset을 설정
-	case FAT32:
-		fatOffset = cluster * 4; 
-		break;
-	case FAT16:
-		fatOffset = cluster * 2;
-		break;
-	case FAT12:
-		fatOffset = cluster + ( cluster / 2 );
-		break;
-	default:
-		WARNING( "Illegal file system type\n" );
-		fatOffset = 0;
-		break;
-	}
+	fatOffset = get_type_entry_offset( fs->typeInfo, cluster ); //파일 시스템에 맞게 fatOffset을 설정
 
 	*fatSector		= fs->bpb.reservedSectorCount + ( fatOffset / fs->bpb.bytesPerSector );//클러스터 FAT Entry가 몇 번째 FAT 섹터에 위치하는지
 	*fatEntryOffset	= fatOffset % fs->bpb.bytesPerSector; // 그 섹터내에서 몇번째 Entry인지
@@ -358,102 +376,464 @@ int get_fat_sector( FAT_FILESYSTEM* fs, SECTOR cluster, SECTOR* fatSector, DWORD
 	return FAT_SUCCESS;
 }
 
-int prepare_fat_sector( FAT_FILESYSTEM* fs, SECTOR cluster, SECTOR* fatSector, DWORD* fatEntryOffset, BYTE* sector )
+/* marks the FAT sector(s) holding the entry of cluster to be written back */
+void mark_fat_dirty( FAT_FILESYSTEM* fs, SECTOR cluster )
 {
-	get_fat_sector( fs, cluster, fatSector, fatEntryOffset ); 
-	// 몇번째 섹터의 몇번째 entry인지
-	fs->disk->read_sector( fs->disk, *fatSector, sector ); //disk의 해당 *fatSector를 read해서 sector버퍼에 저장
+	SECTOR	fatSector;
+	DWORD	fatEntryOffset;
+	DWORD	index;
 
-	if( fs->FATType == FAT12 && *fatEntryOffset == fs->bpb.bytesPerSector - 1 ) //?
-	{
-		// fatEntryOffset이 bytesPerSector즉 sector의 마지막 지점이면 다음 섹터를 sector버퍼로 read
-		fs->disk->read_sector( fs->disk, *fatSector + 1, &sector[fs->bpb.bytesPerSector] );
-		return 1;
-	}
+	get_fat_sector( fs, cluster, &fatSector, &fatEntryOffset );
+	index = fatSector - fs->bpb.reservedSectorCount;
 
-	return 0;
+	fs->fatDirty[index / 8] |= 1 << ( index % 8 );
+	if( fs->FATType == FAT12 && fatEntryOffset == fs->bpb.bytesPerSector - 1 && index + 1 < fs->FATSize )
+		fs->fatDirty[( index + 1 ) / 8] |= 1 << ( ( index + 1 ) % 8 ); // 섹터 경계에 걸친 12bit entry
+}
+
+/* reads one FAT32 entry through the buffer cache, used until the FAT is loaded */
+DWORD read_fat32_entry( FAT_FILESYSTEM* fs, SECTOR cluster )
+{
+	BYTE	sector[MAX_SECTOR_SIZE];
+	SECTOR	fatSector;
+	DWORD	fatEntryOffset;
+
+	get_fat_sector( fs, cluster, &fatSector, &fatEntryOffset );
+	if( fs->disk->read_sector( fs->disk, fatSector, sector ) )
+		return MS_EOC32;
+
+	return ( sector[fatEntryOffset] | ( sector[fatEntryOffset + 1] << 8 ) |
+			 ( sector[fatEntryOffset + 2] << 16 ) | ( ( DWORD )sector[fatEntryOffset + 3] << 24 ) ) & 0x0FFFFFFF;
 }
 
 /* Read a FAT entry from FAT Table */
 // FATable에서 cluster 번호 위치에 적힌 번호를 리턴 <다음 클러스터 불러옴>
 DWORD get_fat( FAT_FILESYSTEM* fs, SECTOR cluster )
 {
-	BYTE	sector[MAX_SECTOR_SIZE * 2]; 
-	SECTOR	fatSector; 
-	DWORD	fatEntryOffset; 
-	
-	
-	prepare_fat_sector( fs, cluster, &fatSector, &fatEntryOffset, sector );
-	// fatSector = FATable[cluster]의 디스크에서의 위치 중 sector인덱스
-	// sector = 해당 sector데이터
-	// fatEntryOffset = FATable[cluster]의 디스크 에서의 위치 중 sector offset
+	if( cluster >= fs->fatEntries )
+		return fs->typeInfo->MS_EOC; // 범위 밖이면 체인의 끝으로 취급
+
+	if( fs->fatTable == NULL )
+		return read_fat32_entry( fs, cluster ); // FSInfo로 mount해서 아직 FAT이 load되지 않음
+
+	return get_type_entry( fs->typeInfo, fs->fatTable, cluster ); // FAT32는 상위 4bit 제외
+}
+
+/* stores one entry into the in-memory table without marking its sector */
+void store_fat_entry( FAT_FILESYSTEM* fs, SECTOR cluster, DWORD value )
+{
+	store_type_entry( fs->typeInfo, fs->fatTable, cluster, value ); // FAT32는 상위 4bit 보존
+}
+
+/* Write a FAT entry to FAT Table */
+int set_fat( FAT_FILESYSTEM* fs, SECTOR cluster, DWORD value )
+{
+	if( cluster >= fs->fatEntries || prepare_fat( fs ) )
+		return FAT_ERROR;
+
+	store_fat_entry( fs, cluster, value );
+	mark_fat_dirty( fs, cluster ); // disk에는 flush_fat에서 반영
+
+	return FAT_SUCCESS;
+}
+
+/******************************************************************************/
+/* FAT update batch                                                           */
+/******************************************************************************/
+/*
+ * A batch collects entry updates of one operation and applies them in FAT order
+ * on commit, so every FAT sector touched is marked dirty (and later encoded and
+ * written by flush_fat) once, however many of its entries changed. Only the last
+ * update of a cluster is applied, and the free cluster bitmap follows that value:
+ * FREE_CLUSTER returns the cluster to it, any other value takes it out. get_fat
+ * keeps seeing the old values until the commit.
+ */
+void fat_batch_begin( FAT_FILESYSTEM* fs, FAT_BATCH* batch )
+{
+	ZeroMemory( batch, sizeof( FAT_BATCH ) );
+	batch->fs = fs;
+}
+
+int fat_batch_set( FAT_BATCH* batch, DWORD cluster, DWORD value )
+{
+	if( cluster < 2 || cluster >= batch->fs->fatEntries )
+		return FAT_ERROR;
+
+	if( batch->count == batch->capacity )
+	{
+		UINT32		capacity = ( batch->capacity ? batch->capacity * 2 : FAT_BATCH_INITIAL );
+		FAT_UPDATE*	updates = ( FAT_UPDATE* )realloc( batch->updates, capacity * sizeof( FAT_UPDATE ) );
+
+		if( updates == NULL )
+			return FAT_ERROR;
+
+		batch->updates = updates;
+		batch->capacity = capacity;
+	}
+
+	batch->updates[batch->count].cluster	= cluster;
+	batch->updates[batch->count].value		= value;
+	batch->updates[batch->count].order		= batch->count;
+	batch->count++;
+
+	return FAT_SUCCESS;
+}
+
+int compare_fat_updates( const void* a, const void* b )
+{
+	const FAT_UPDATE*	x = ( const FAT_UPDATE* )a;
+	const FAT_UPDATE*	y = ( const FAT_UPDATE* )b;
+
+	if( x->cluster != y->cluster )
+		return ( x->cluster < y->cluster ? -1 : 1 );
+
+	return ( x->order < y->order ? -1 : ( x->order > y->order ) ); // 같은 cluster면 나중 것이 남도록
+}
+
+int fat_batch_commit( FAT_BATCH* batch )
+{
+	FAT_FILESYSTEM*	fs = batch->fs;
+	SECTOR			fatSector, lastSector = 0;
+	DWORD			fatEntryOffset;
+	UINT32			i;
+
+	if( batch->count && prepare_fat( fs ) )
+	{
+		fat_batch_abort( batch );
+		return FAT_ERROR;
+	}
+
+	if( batch->count > 1 ) // 빈 batch는 updates가 NULL
+		qsort( batch->updates, batch->count, sizeof( FAT_UPDATE ), compare_fat_updates );
+
+	for( i = 0; i < batch->count; i++ )
+	{
+		if( i + 1 < batch->count && batch->updates[i + 1].cluster == batch->updates[i].cluster )
+			continue; // 같은 cluster의 마지막 update만 적용
+
+		store_fat_entry( fs, batch->updates[i].cluster, batch->updates[i].value );
+
+		if( batch->updates[i].value == FREE_CLUSTER )
+			set_cluster_free( &fs->freeClusterMap, batch->updates[i].cluster );
+		else
+			set_cluster_used( &fs->freeClusterMap, batch->updates[i].cluster );
+
+		get_fat_sector( fs, batch->updates[i].cluster, &fatSector, &fatEntryOffset );
+		if( fatSector != lastSector || ( fs->FATType == FAT12 && fatEntryOffset == fs->bpb.bytesPerSector - 1 ) )
+			mark_fat_dirty( fs, batch->updates[i].cluster ); // sector마다 한번만
+		lastSector = fatSector;
+	}
+
+	fat_batch_abort( batch );
+
+	return FAT_SUCCESS;
+}
+
+void fat_batch_abort( FAT_BATCH* batch )
+{
+	free( batch->updates );
+	batch->updates = NULL;
+	batch->count = 0;
+	batch->capacity = 0;
+}
+
+/* stores one 12bit entry into a sector, offset is relative to the sector and may be out of it */
+void put_fat12( BYTE* sector, INT32 offset, INT32 bytesPerSector, DWORD cluster, DWORD value )
+{
+	if( cluster & 1 )
+	{
+		if( offset >= 0 && offset < bytesPerSector )
+			sector[offset] = ( sector[offset] & 0x0F ) | ( BYTE )( ( value << 4 ) & 0xF0 );
+		if( offset + 1 >= 0 && offset + 1 < bytesPerSector )
+			sector[offset + 1] = ( BYTE )( value >> 4 );
+	}
+	else
+	{
+		if( offset >= 0 && offset < bytesPerSector )
+			sector[offset] = ( BYTE )value;
+		if( offset + 1 >= 0 && offset + 1 < bytesPerSector )
+			sector[offset + 1] = ( sector[offset + 1] & 0xF0 ) | ( BYTE )( ( value >> 8 ) & 0x0F );
+	}
+}
+
+/* builds the raw contents of the index'th FAT sector from the decoded table */
+void encode_fat_sector( FAT_FILESYSTEM* fs, DWORD index, BYTE* sector )
+{
+	DWORD	bytesPerSector = fs->bpb.bytesPerSector;
+	DWORD	base = index * bytesPerSector;
+	DWORD	cluster, offset, value;
+
+	ZeroMemory( sector, bytesPerSector );
 
 	switch( fs->FATType )
 	{
-		// FAT 버전에 따라서 FAT table의 크기가 다르기 때문에 하나의 entry를 추출해서 return하는 방식이 다름
-		// 결국 하는 짓은 해당 섹터[오프셋]위치의 파일의 주소를 리턴
 	case FAT32:
-		return ( *( ( DWORD* )&sector[fatEntryOffset] ) ) & 0xFFFFFFF;
+		for( cluster = base / 4; cluster < fs->fatEntries && cluster < ( base + bytesPerSector ) / 4; cluster++ )
+		{
+			offset = cluster * 4 - base;
+			value = fs->fatTable[cluster];
+			sector[offset]		= ( BYTE )value;
+			sector[offset + 1]	= ( BYTE )( value >> 8 );
+			sector[offset + 2]	= ( BYTE )( value >> 16 );
+			sector[offset + 3]	= ( BYTE )( value >> 24 );
+		}
+		break;
 	case FAT16:
-		return ( DWORD )( *( ( WORD *)&sector[fatEntryOffset] ) );
+		for( cluster = base / 2; cluster < fs->fatEntries && cluster < ( base + bytesPerSector ) / 2; cluster++ )
+		{
+			offset = cluster * 2 - base;
+			value = fs->fatTable[cluster];
+			sector[offset]		= ( BYTE )value;
+			sector[offset + 1]	= ( BYTE )( value >> 8 );
+		}
+		break;
 	case FAT12:
-		/*
-		12bit를 추출
-		even일 경우, 12bits * 2n = 24bits * n이고 바이트 단위 정렬이 됨
-		odd일 경우, 12bits * 2(n+1) -> 바이트 정렬이 안됨
-		-> n이 1일 경우, 12bit에 접근하기 위해 8bit 즉 바이트로 접근한 뒤에 4bit를 버린다.
-		*/
-		if( cluster & 1 )	/* Cluster number is ODD	*/
-			return ( DWORD )( *( ( WORD *)&sector[fatEntryOffset] ) >> 4 );
-		else				/* Cluster number is EVEN	*/
-			return ( DWORD )( *( ( WORD *)&sector[fatEntryOffset] ) & 0xFFF );
+		cluster = ( base * 2 ) / 3;
+		if( cluster > 0 )
+			cluster--; // 앞 섹터에서 걸쳐 들어오는 entry부터
+		for( ; cluster < fs->fatEntries && cluster + cluster / 2 < base + bytesPerSector; cluster++ )
+			put_fat12( sector, ( INT32 )( cluster + cluster / 2 ) - ( INT32 )base, bytesPerSector, cluster, fs->fatTable[cluster] );
+		break;
 	}
+}
 
-	return FAT_ERROR;
+/* Decodes 'count' entries of a FAT chunk starting at entry 'first' into the table
+ * and sets the bits of the free ones in the free cluster bitmap */
+void scan_fat_chunk( FAT_FILESYSTEM* fs, const BYTE* buffer, DWORD first, DWORD count )
+{
+	DWORD	i, n;
+	UINT64	freeBits;
+
+	for( i = 0; i < count; i += FAT_SCAN_GROUP )
+	{
+		n = MIN( FAT_SCAN_GROUP, count - i );
+
+		switch( fs->FATType )
+		{
+		case FAT32:
+			freeBits = scan_fat32( buffer + i * 4, fs->fatTable + first + i, n );
+			break;
+		case FAT16:
+			freeBits = scan_fat16( buffer + i * 2, fs->fatTable + first + i, n );
+			break;
+		default:
+			freeBits = scan_fat12( buffer + i / 2 * 3, fs->fatTable + first + i, n ); // i는 짝수
+			break;
+		}
+
+		merge_free_bits( &fs->freeClusterMap, first + i, freeBits, n );
+	}
 }
 
-/* Write a FAT entry to FAT Table */
-int set_fat( FAT_FILESYSTEM* fs, SECTOR cluster, DWORD value )
+/* counts the FAT entries which are backed by data clusters */
+void init_fat_geometry( FAT_FILESYSTEM* fs )
 {
-	BYTE	sector[MAX_SECTOR_SIZE * 2];
-	SECTOR	fatSector; //몇번째섹터인지
-	DWORD	fatEntryOffset; // 해당섹터의 몇번째인지
-	int		result;
+	UINT32	totalSectors, dataSector, rootSector, countOfClusters;
+	UINT32	maxEntries;
+
+	rootSector = ( ( fs->bpb.rootEntryCount * 32 ) + ( fs->bpb.bytesPerSector - 1 ) ) / fs->bpb.bytesPerSector;
+	totalSectors = ( fs->bpb.totalSectors != 0 ? fs->bpb.totalSectors : fs->bpb.totalSectors32 );
+	dataSector = totalSectors - ( fs->bpb.reservedSectorCount + ( fs->bpb.numberOfFATs * fs->FATSize ) + rootSector );
+	countOfClusters = dataSector / fs->bpb.sectorsPerCluster;
 
-	result = prepare_fat_sector( fs, cluster, &fatSector, &fatEntryOffset, sector );
-	// 몇번째 Sector의 몇번째 byteoffset인지 계산해서
+	// FAT 영역에 실제로 들어갈 수 있는 entry 수를 넘지 않도록
 	switch( fs->FATType )
 	{
-		//그 장소에 value(eoc)를 파일시스템에 맞게 비트연산 해서 삽입
 	case FAT32:
-		value &= 0x0FFFFFFF;
-		*( ( DWORD* )&sector[fatEntryOffset] ) &= 0xF0000000;
-		*( ( DWORD* )&sector[fatEntryOffset] ) |= value;
+		maxEntries = fs->FATSize * fs->bpb.bytesPerSector / 4;
 		break;
 	case FAT16:
-		*( ( WORD* )&sector[fatEntryOffset] ) = ( WORD )value;
+		maxEntries = fs->FATSize * fs->bpb.bytesPerSector / 2;
 		break;
-	case FAT12:
-		if( cluster & 1 )
+	default:
+		maxEntries = fs->FATSize * fs->bpb.bytesPerSector * 2 / 3;
+		break;
+	}
+	fs->fatEntries = MIN( countOfClusters + 2, maxEntries );
+}
+
+/* frees what a failed load_fat has built, fatEntries is kept for the next try */
+void release_partial_fat( FAT_FILESYSTEM* fs )
+{
+	free( fs->fatTable );
+	free( fs->fatDirty );
+	fs->fatTable = NULL;
+	fs->fatDirty = NULL;
+	release_cluster_bitmap( &fs->freeClusterMap );
+}
+
+/* Loads the first FAT into the decoded in-memory table and builds the free cluster
+ * bitmap in the same pass. The FAT is read LOAD_FAT_SECTORS at a time. On an error
+ * neither the table nor the bitmap is left */
+int load_fat( FAT_FILESYSTEM* fs )
+{
+	UINT32	entriesPerChunk;
+	UINT32	i, sectors, first;
+	BYTE*	buffer;
+
+	switch( fs->FATType )
+	{
+	case FAT32:
+		entriesPerChunk = LOAD_FAT_SECTORS * fs->bpb.bytesPerSector / 4;
+		break;
+	case FAT16:
+		entriesPerChunk = LOAD_FAT_SECTORS * fs->bpb.bytesPerSector / 2;
+		break;
+	default:
+		entriesPerChunk = LOAD_FAT_SECTORS * fs->bpb.bytesPerSector * 2 / 3; // chunk는 3 byte 경계에서 끝남
+		break;
+	}
+
+	fs->fatTable = ( DWORD* )malloc( fs->fatEntries * sizeof( DWORD ) );
+	fs->fatDirty = ( BYTE* )calloc( ( fs->FATSize + 7 ) / 8, 1 );
+	buffer = ( BYTE* )malloc( LOAD_FAT_SECTORS * fs->bpb.bytesPerSector + 4 );
+	if( fs->fatTable == NULL || fs->fatDirty == NULL || buffer == NULL ||
+		init_cluster_bitmap( &fs->freeClusterMap, fs->fatEntries ) )
+	{
+		free( buffer );
+		release_partial_fat( fs );
+		return FAT_ERROR;
+	}
+
+	for( i = 0, first = 0; i < fs->FATSize && first < fs->fatEntries; i += sectors, first += entriesPerChunk )
+	{
+		sectors = MIN( LOAD_FAT_SECTORS, fs->FATSize - i );
+		if( fs->disk->read_sectors( fs->disk, fs->bpb.reservedSectorCount + i, sectors, buffer, NULL, 0 ) )
 		{
-			value <<= 4;
-			*( ( WORD* )&sector[fatEntryOffset] ) &= 0x000F;
+			free( buffer );
+			release_partial_fat( fs ); // 반쯤 scan된 bitmap이 FSInfo에 쓰이지 않도록
+			return FAT_ERROR;
 		}
-		else
+		memset( buffer + sectors * fs->bpb.bytesPerSector, 0, 4 ); // FAT12 마지막 pair가 넘어서 읽는 byte
+
+		scan_fat_chunk( fs, buffer, first, MIN( entriesPerChunk, fs->fatEntries - first ) );
+	}
+	free( buffer );
+
+	// 0, 1번 cluster는 다른 목적으로 사용
+	// 실제 data가 들어가는 cluster는 2번부터 시작
+	set_cluster_used( &fs->freeClusterMap, 0 );
+	set_cluster_used( &fs->freeClusterMap, 1 );
+	count_free_clusters( &fs->freeClusterMap ); // popcount로 free cluster 개수 계산
+	fs->freeClusterMap.hint = 2;
+
+	return FAT_SUCCESS;
+}
+
+/* Loads the FAT on the first modification when the mount trusted FSInfo instead of
+ * scanning. The search for free clusters continues from FSInfo's nextFree */
+int prepare_fat( FAT_FILESYSTEM* fs )
+{
+	if( fs->fatTable )
+		return FAT_SUCCESS;
+
+	if( load_fat( fs ) )
+		return FAT_ERROR;
+
+	if( fs->info32.nextFree >= 2 && fs->info32.nextFree < fs->fatEntries )
+		fs->freeClusterMap.hint = fs->info32.nextFree;
+
+	return FAT_SUCCESS;
+}
+
+/* reads the FSInfo sector of a FAT32 volume, fs->fsInfoSector is set only if it is valid */
+int read_fsinfo( FAT_FILESYSTEM* fs )
+{
+	BYTE	sector[MAX_SECTOR_SIZE];
+
+	fs->fsInfoSector = 0;
+
+	if( fs->FATType != FAT32 || fs->bpb.BPB32.FSInfo == 0 || fs->bpb.BPB32.FSInfo >= fs->bpb.reservedSectorCount )
+		return FAT_ERROR;
+
+	if( fs->disk->read_sector( fs->disk, fs->bpb.BPB32.FSInfo, sector ) )
+		return FAT_ERROR;
+	memcpy( &fs->info32, sector, sizeof( FAT_FSINFO ) );
+
+	if( fs->info32.leadSignature != FSINFO_LEAD_SIGNATURE ||
+		fs->info32.structSignature != FSINFO_STRUCT_SIGNATURE ||
+		fs->info32.trailSignature != FSINFO_TRAIL_SIGNATURE )
+		return FAT_ERROR;
+
+	fs->fsInfoSector = fs->bpb.BPB32.FSInfo;
+
+	return FAT_SUCCESS;
+}
+
+/* Stores freeCount and nextFree to the FSInfo sector, the rest of the sector is kept.
+ * The sector is written through to the device, so the unknown count of a mount is on the
+ * disk before any FAT or data change, and the count of an umount only after them */
+int write_fsinfo( FAT_FILESYSTEM* fs, UINT32 freeCount, UINT32 nextFree )
+{
+	BYTE	sector[MAX_SECTOR_SIZE];
+
+	if( fs->fsInfoSector == 0 )
+		return FAT_SUCCESS;
+
+	if( fs->disk->read_sector( fs->disk, fs->fsInfoSector, sector ) )
+		return FAT_ERROR;
+
+	( ( FAT_FSINFO* )sector )->freeCount = freeCount;
+	( ( FAT_FSINFO* )sector )->nextFree = nextFree;
+
+	if( fs->disk->write_sector( fs->disk, fs->fsInfoSector, sector ) )
+		return FAT_ERROR;
+
+	return ( bcache_flush( &fs->cache ) ? FAT_ERROR : FAT_SUCCESS ); // cache에 남기지 않고 device까지 write
+}
+
+/* writes the dirty FAT sectors back to every copy of the FAT */
+int flush_fat( FAT_FILESYSTEM* fs )
+{
+	BYTE	sectors[MAX_SECTOR_SIZE * FLUSH_FAT_SECTORS];
+	DWORD	index, count, i;
+	UINT32	copy;
+	int		failed, result = FAT_SUCCESS;
+
+	if( fs->fatTable == NULL )
+		return FAT_SUCCESS;
+
+	for( index = 0; index < fs->FATSize; index += MAX( count, 1 ) )
+	{
+		// 이어진 dirty sector들을 모아서 한번에 write
+		count = 0;
+		while( index + count < fs->FATSize && count < FLUSH_FAT_SECTORS &&
+			   ( fs->fatDirty[( index + count ) / 8] & ( 1 << ( ( index + count ) % 8 ) ) ) )
 		{
-			value &= 0x0FFF;
-			*( ( WORD* )&sector[fatEntryOffset] ) &= 0xF000;
+			encode_fat_sector( fs, index + count, &sectors[count * fs->bpb.bytesPerSector] );
+			count++;
 		}
-		*( ( WORD* )&sector[fatEntryOffset] ) |= ( WORD )value;
-		break;
+
+		if( count == 0 )
+			continue;
+
+		failed = 0;
+		for( copy = 0; copy < fs->bpb.numberOfFATs; copy++ ) // 모든 FAT 사본에 반영
+		{
+			if( fs->disk->write_sectors( fs->disk, fs->bpb.reservedSectorCount + copy * fs->FATSize + index, count, sectors, NULL, 0 ) )
+				failed = 1;
+		}
+
+		if( failed )
+		{
+			result = FAT_ERROR; // dirty로 남겨 다음 flush에서 다시 write
+			continue;
+		}
+
+		for( i = index; i < index + count; i++ )
+			fs->fatDirty[i / 8] &= ~( 1 << ( i % 8 ) );
 	}
 
-	fs->disk->write_sector( fs->disk, fatSector, sector );
-	//sector[fatEntryOffset]를 설정해서 fatSector에 write
-	if( result ) //prepare에서 sector offset이 sector 넘어가면 , 다음 섹터에 write
-		fs->disk->write_sector( fs->disk, fatSector + 1, &sector[fs->bpb.bytesPerSector] );
+	return result;
+}
 
-	return FAT_SUCCESS;
+void release_fat( FAT_FILESYSTEM* fs )
+{
+	free( fs->fatTable );
+	free( fs->fatDirty );
+	fs->fatTable = NULL;
+	fs->fatDirty = NULL;
+	fs->fatEntries = 0;
 }
 
 /******************************************************************************/
@@ -478,6 +858,8 @@ int fat_format( DISK_OPERATIONS* disk, BYTE FATType )
 
 	clear_fat( disk, &bpb ); // FAT영역 초기화 코드
 	create_root( disk, &bpb ); // root sector 생성및 정보삽입
+	if( FATType == FAT32 )
+		create_fsinfo( disk, &bpb ); // free cluster 수는 첫 mount에서 계산
 
 	return FAT_SUCCESS;
 }
@@ -509,6 +891,15 @@ int read_root_sector( FAT_FILESYSTEM* fs, SECTOR sectorNumber, BYTE* sector )
 	return fs->disk->read_sector( fs->disk, rootSector + sectorNumber, sector ); //해당 sector를 read
 }
 
+int read_root_sectors( FAT_FILESYSTEM* fs, SECTOR sectorNumber, SECTOR count, BYTE* sectors )
+{
+	SECTOR	rootSector;
+
+	rootSector = fs->bpb.reservedSectorCount + ( fs->bpb.numberOfFATs * fs->bpb.FATSize16 );
+
+	return fs->disk->read_sectors( fs->disk, rootSector + sectorNumber, count, sectors, NULL, 0 );
+}
+
 
 int write_root_sector( FAT_FILESYSTEM* fs, SECTOR sectorNumber, const BYTE* sector )
 {
@@ -544,47 +935,117 @@ int write_data_sector( FAT_FILESYSTEM* fs, SECTOR clusterNumber, SECTOR sectorNu
 	return fs->disk->write_sector( fs->disk, calc_physical_sector( fs, clusterNumber, sectorNumber ), sector );
 }
 
-/* search free clusters from FAT and add to free cluster list */
-int search_free_clusters( FAT_FILESYSTEM* fs )
+/* count sectors may run past the cluster as long as the following clusters are physically adjacent */
+int read_data_sectors( FAT_FILESYSTEM* fs, SECTOR clusterNumber, SECTOR sectorNumber, SECTOR count, BYTE* buffer )
 {
-	UINT32	totalSectors, dataSector, rootSector, countOfClusters, FATSize;
-	UINT32	i, cluster;
-
-	// root 디렉토리의 크기를 sector 단위로 계산
+	return fs->disk->read_sectors( fs->disk, calc_physical_sector( fs, clusterNumber, sectorNumber ), count, buffer, NULL, 0 );
+}
 
-	rootSector = ( ( fs->bpb.rootEntryCount * 32 ) + ( fs->bpb.bytesPerSector - 1 ) ) / fs->bpb.bytesPerSector;
+int write_data_sectors( FAT_FILESYSTEM* fs, SECTOR clusterNumber, SECTOR sectorNumber, SECTOR count, const BYTE* buffer )
+{
+	return fs->disk->write_sectors( fs->disk, calc_physical_sector( fs, clusterNumber, sectorNumber ), count, buffer, NULL, 0 );
+}
 
-	if( fs->bpb.FATSize16 != 0 ) //fat16이면
-		FATSize = fs->bpb.FATSize16;
-	else
-		FATSize = fs->bpb.BPB32.FATSize32; //fat32면
+/* Finds the 'index'th cluster of the chain starting at 'firstCluster' through its extent
+ * map, walking the FAT only past the part which is mapped already. On success 'count'
+ * receives the number of mapped clusters which follow contiguously from it. If the chain
+ * is shorter, FAT_ERROR is returned with its last cluster in 'cluster' and its length in 'count' */
+int map_file_cluster( FAT_FILESYSTEM* fs, DWORD firstCluster, DWORD index, DWORD* cluster, DWORD* count )
+{
+	const FAT_TYPE_INFO*	type = fs->typeInfo;
+	EXTENT_MAP*	map;
+	DWORD		nextCluster, following, length;
 
-	if( fs->bpb.totalSectors != 0 )
-		totalSectors = fs->bpb.totalSectors;
+	map = get_extent_map( &fs->extentCache, firstCluster );
+	if( map->clusters == 0 )
+		nextCluster = firstCluster;
 	else
-		totalSectors = fs->bpb.totalSectors32;
-
-	// data 영역의 크기를 sector 단위로 계산
-	// reserved 영역, FAT 영역, root 디렉토리를 할당하고 남은 영역
-	dataSector = totalSectors - ( fs->bpb.reservedSectorCount + ( fs->bpb.numberOfFATs * FATSize ) + rootSector );
+		nextCluster = get_fat( fs, get_extent_last_cluster( map ) );
 
-	// 섹터영역 클러스터 크기로 나누어 cluster 단위로 환산
-	countOfClusters = dataSector / fs->bpb.sectorsPerCluster;
+	while( index >= map->clusters )
+	{
+		if( is_type_eoc( type, nextCluster ) || nextCluster < 2 || nextCluster >= fs->fatEntries ||
+			map->clusters >= fs->fatEntries ) // 체인의 끝, 또는 깨진 체인
+		{
+			*cluster = ( map->clusters ? get_extent_last_cluster( map ) : 0 );
+			*count = map->clusters;
+			return FAT_ERROR;
+		}
 
+		if( fs->fatTable )
+			length = follow_type_run( type, fs->fatTable, fs->fatEntries, nextCluster, &following ); // 연속된 run을 한번에
+		else
+		{
+			length = 1;
+			following = get_fat( fs, nextCluster );
+		}
 
-	// 0, 1번 cluster는 다른 목적으로 사용
-	// 실제 data가 들어가는 cluster는 2번부터 시작
-	for( i = 2; i < countOfClusters; i++ )
-	{
-		cluster = get_fat( fs, i );
-		if( cluster == FREE_CLUSTER )
-			add_free_cluster( fs, i ); // fs->clustlist에 freeclust 추가
+		if( append_extent_run( map, nextCluster, length ) )
+			return FAT_ERROR;
+		nextCluster = following;
 	}
 
-	return FAT_SUCCESS;
+	return lookup_extent( map, index, cluster, count );
 }
 
-int fat_read_superblock( FAT_FILESYSTEM* fs, FAT_NODE* root )
+/* clusters a stream may read ahead, half of the buffer cache. 0 if a cluster does not fit */
+DWORD get_readahead_limit( FAT_FILESYSTEM* fs )
+{
+	return fs->cache.numberOfBuffers / 2 / fs->bpb.sectorsPerCluster;
+}
+
+/* Reads 'count' clusters of the chain from 'cluster' into the buffer cache, one prefetch
+ * per run of physically contiguous clusters. Stops early at the end of the chain */
+int prefetch_clusters( FAT_FILESYSTEM* fs, DWORD cluster, DWORD count )
+{
+	const FAT_TYPE_INFO*	type = fs->typeInfo;
+	DWORD	first, length;
+
+	while( count > 0 && cluster >= 2 && cluster < fs->fatEntries && !is_type_eoc( type, cluster ) )
+	{
+		first = cluster;
+		length = 0;
+		do
+		{
+			length++;
+			cluster = get_fat( fs, cluster );
+		} while( length < count && cluster == first + length ); // 물리적으로 이어지는 동안
+
+		if( bcache_prefetch( &fs->cache, calc_physical_sector( fs, first, 0 ), length * fs->bpb.sectorsPerCluster ) )
+			return FAT_ERROR;
+		count -= length;
+	}
+
+	return FAT_SUCCESS;
+}
+
+/* Counts the sectors from 'sectorNumber' of the cursor's cluster, up to 'wanted', which
+ * are physically contiguous on the disk. The cursor is moved to the cluster holding the
+ * last of them */
+SECTOR get_file_run( FAT_NODE* file, FAT_CURSOR* cursor, SECTOR sectorNumber, SECTOR wanted )
+{
+	DWORD	sectorsPerCluster = file->fs->bpb.sectorsPerCluster;
+	DWORD	cluster, run, clusters;
+	SECTOR	sectors;
+
+	if( sectorNumber + wanted <= sectorsPerCluster )
+		return wanted; // 한 cluster 안에서 끝남
+
+	// 필요한 cluster까지 extent map을 늘려 두고 run 길이를 구함
+	map_file_cluster( file->fs, GET_FIRST_CLUSTER( file->entry ), cursor->seq + ( sectorNumber + wanted - 1 ) / sectorsPerCluster, &cluster, &run );
+	if( map_file_cluster( file->fs, GET_FIRST_CLUSTER( file->entry ), cursor->seq, &cluster, &run ) )
+		run = 1;
+
+	sectors = MIN( run * sectorsPerCluster - sectorNumber, wanted );
+	clusters = ( sectorNumber + sectors - 1 ) / sectorsPerCluster;
+
+	cursor->seq += clusters;
+	cursor->cluster += clusters; // run 안의 cluster들은 물리적으로 연속
+
+	return sectors;
+}
+
+int fat_read_superblock( FAT_FILESYSTEM* fs, FAT_NODE* root )
 {
 	/* 
 	1. 부트 파라미터 블록을 읽어들여 내용이 유효한지 검사
@@ -619,10 +1080,18 @@ int fat_read_superblock( FAT_FILESYSTEM* fs, FAT_NODE* root )
 	fs->FATType = get_fat_type( &fs->bpb ); // bpb의 타입 얻어옴 
 	if( fs->FATType > FAT32 ) //FAT12~32 아니면
 		return FAT_ERROR;
+	fs->typeInfo = get_fat_type_info( fs->FATType ); // FAT entry 접근에 쓰는 타입별 상수
 
+	if( bcache_init( &fs->cache, fs->disk, fs->cacheSize ? fs->cacheSize : FAT_CACHE_SECTORS ) )
+		return FAT_ERROR;
+	fs->disk = &fs->cache.disk;
+	// 이후의 모든 sector 입출력은 버퍼 캐시를 거침
 	
 	if( read_root_sector( fs, 0, sector ) )
+	{
+		fat_umount( fs );
 		return FAT_ERROR;
+	}
 	//sector 버퍼에 Root directory sector읽어옴
 
 
@@ -633,6 +1102,38 @@ int fat_read_superblock( FAT_FILESYSTEM* fs, FAT_NODE* root )
 	
 	
 
+	if( fs->bpb.FATSize16 != 0 ) // FATSize16이 0이면 FAT32
+		fs->FATSize = fs->bpb.FATSize16;
+	else
+		fs->FATSize = fs->bpb.BPB32.FATSize32;
+	// FATsize를 FAT32인 경우 FAT32size, FAT(12,16)인 경우 FATSize16으로 설정
+
+	init_fat_geometry( fs );
+	init_extent_cache( &fs->extentCache );
+	init_dir_index_cache( &fs->dirIndex );
+	init_dentry_cache( &fs->dentryCache );
+	ZeroMemory( &fs->readahead, sizeof( FAT_READAHEAD ) );
+
+	if( read_fsinfo( fs ) == FAT_SUCCESS && fs->info32.freeCount <= fs->fatEntries - 2 )
+	{
+		// FSInfo의 freeCount가 유효하면 FAT scan 없이 mount, FAT은 처음 변경될 때 load
+	}
+	else if( load_fat( fs ) )
+	{
+		fs->fsInfoSector = 0; // 실패한 mount는 FSInfo를 건드리지 않음
+		fat_umount( fs );
+		return FAT_ERROR;
+	}
+	// FAT 전체를 메모리에 decode하면서 free cluster bitmap도 구성, 이후 get_fat/set_fat은 disk에 접근하지 않음
+
+	if( fs->fsInfoSector && write_fsinfo( fs, FSINFO_UNKNOWN, fs->info32.nextFree ) )
+	{
+		fs->fsInfoSector = 0;
+		fat_umount( fs );
+		return FAT_ERROR;
+	}
+	// 정상적으로 umount되지 않으면 다음 mount는 FSInfo를 믿지 않고 scan
+
 	fs->EOCMark = get_fat( fs, 1 );
 	if( fs->FATType == 2 ) //32
 	{
@@ -652,229 +1153,454 @@ int fat_read_superblock( FAT_FILESYSTEM* fs, FAT_NODE* root )
 		}
 	}
 	// FAT 파일 시스템에 맞는 EOC(end of cluster)인지 체크, 버전마다 eoc비트열이 모두 다름
-	
-	if( fs->bpb.FATSize16 != 0 ) // FATSize16이 0이면 FAT32
-		fs->FATSize = fs->bpb.FATSize16;
-	else
-		fs->FATSize = fs->bpb.BPB32.FATSize32;
-	// FATsize를 FAT32인 경우 FAT32size, FAT(12,16)인 경우 FATSize16으로 설정
-
-	init_cluster_list( &fs->freeClusterList );
-	// freeClusterList초기화
-
 
-	search_free_clusters( fs );
-	// free cluster 검색 및 클러스트 리스트에 추가
 
 	memset( root->entry.name, 0x20, 11 );
 	// entry.name 초기화
+	fs->rootEntry = root->entry; // 절대 경로는 여기서 시작
 	return FAT_SUCCESS;
 }
 
 /******************************************************************************/
 /* On unmount file system                                                     */
 /******************************************************************************/
-void fat_umount( FAT_FILESYSTEM* fs )
+/* The free count is stored to FSInfo only when the FAT and the data reached the disk.
+ * Otherwise the FSINFO_UNKNOWN of the mount stays, and the next mount scans the FAT */
+int fat_umount( FAT_FILESYSTEM* fs )
 {
-	release_cluster_list( &fs->freeClusterList );
-}
-
-int read_dir_from_sector( FAT_FILESYSTEM* fs, FAT_ENTRY_LOCATION* location, BYTE* sector, FAT_NODE_ADD adder, void* list )
-{
-	UINT		i, entriesPerSector;
-	FAT_DIR_ENTRY*	dir;
-	FAT_NODE	node;
+	int		result;
 
-	entriesPerSector = fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY );
-	dir = ( FAT_DIR_ENTRY* )sector;
+	result = flush_fat( fs ); // 변경된 FAT sector들을 모든 FAT 사본에 write
+	if( fs->cache.device && bcache_flush( &fs->cache ) ) // FAT과 data가 disk에 간 뒤에 FSInfo를 write
+		result = FAT_ERROR;
 
-	for( i = 0; i < entriesPerSector; i++ )
+	if( result == FAT_SUCCESS )
 	{
-		if( dir->name[0] == DIR_ENTRY_FREE )
-			;
-		else if( dir->name[0] == DIR_ENTRY_NO_MORE )
-			break;
-		else if( !( dir->attribute & ATTR_VOLUME_ID ) )
-		{
-			node.fs = fs;
-			node.location = *location;
-			node.location.number = i;
-			node.entry = *dir;
-			adder( list, &node );		/* call the callback function that adds entries to list */
-		}
+		if( fs->fatTable )
+			result = write_fsinfo( fs, fs->freeClusterMap.freeCount, fs->freeClusterMap.hint );
+		else
+			result = write_fsinfo( fs, fs->info32.freeCount, fs->info32.nextFree ); // FAT이 변경되지 않았으면 읽은 값 그대로
+	}
+	fs->fsInfoSector = 0;
 
-		dir++;
+	release_extent_cache( &fs->extentCache );
+	release_dir_index_cache( &fs->dirIndex );
+	release_cluster_bitmap( &fs->freeClusterMap );
+	release_fat( fs );
+
+	if( fs->cache.device )
+	{
+		bcache_uninit( &fs->cache ); // dirty sector들을 disk에 write back
+		fs->disk = fs->cache.device;
 	}
 
-	return ( i == entriesPerSector ? 0 : -1 );
+	return result;
 }
 
+/******************************************************************************/
+/* Write back everything cached for the file system                           */
+/******************************************************************************/
+int fat_sync( FAT_FILESYSTEM* fs )
+{
+	int	result;
+
+	result = flush_fat( fs );
+	result |= bcache_flush( &fs->cache );
+
+	return ( result ? FAT_ERROR : FAT_SUCCESS );
+}
+
+/* by FAT type, for callers without a mounted file system; fs->typeInfo is used otherwise */
 DWORD get_MS_EOC( BYTE FATType )
 {
-	switch( FATType )
+	const FAT_TYPE_INFO*	type = get_fat_type_info( FATType );
+
+	if( type == NULL )
 	{
-	case FAT12:
-		return MS_EOC12;
-	case FAT16:
-		return MS_EOC16;
-	case FAT32:
-		return MS_EOC32;
+		WARNING( "Incorrect FATType(%u)\n", FATType );
+		return -1;
 	}
 
-	WARNING( "Incorrect FATType(%u)\n", FATType );
-	return -1;
+	return type->MS_EOC;
 }
 
 int is_EOC( BYTE FATType, SECTOR clusterNumber )
 {
-	switch( FATType )
-	{
-	case FAT12:
-		if( EOC12 <= ( clusterNumber & 0xFFF ) )
-			return -1;
-
-		break;
-	case FAT16:
-		if( EOC16 <= ( clusterNumber & 0xFFFF ) )
-			return -1;
+	const FAT_TYPE_INFO*	type = get_fat_type_info( FATType );
 
-		break;
-	case FAT32:
-		if( EOC32 <= ( clusterNumber & 0x0FFFFFFF ) )
-			return -1;
-		break;
-	default:
+	if( type == NULL )
+	{
 		WARNING( "Incorrect FATType(%u)\n", FATType );
+		return 0;
 	}
 
-	return 0;
+	return ( is_type_eoc( type, clusterNumber ) ? -1 : 0 );
 }
 
 /******************************************************************************/
 /* Read all entries in the current directory                                  */
 /******************************************************************************/
-int fat_read_dir( FAT_NODE* dir, FAT_NODE_ADD adder, void* list )
+/* positions 'cursor' before the first entry of 'dir', nothing is read yet */
+int fat_opendir( const FAT_NODE* dir, FAT_DIR* cursor )
 {
-	BYTE	sector[MAX_SECTOR_SIZE];
-	SECTOR	i, j, rootEntryCount;
-	FAT_ENTRY_LOCATION location;
+	cursor->fs			= dir->fs;
+	cursor->isRoot		= IS_POINT_ROOT_ENTRY( dir->entry ) && ( dir->fs->FATType == FAT12 || dir->fs->FATType == FAT16 );
+	cursor->ended		= 0;
+	cursor->cluster		= ( cursor->isRoot ? 0 : GET_FIRST_CLUSTER( dir->entry ) );
+	cursor->sector		= 0;
+	cursor->count		= 0;
+	cursor->index		= 0;
+	cursor->pending		= 0;
+	cursor->clusterIndex	= 0;
+	cursor->ahead		= 0;
+	cursor->window		= 0;
+
+	if( !cursor->isRoot && cursor->cluster < 2 )
+		cursor->ended = 1; // 읽을 cluster가 없음
+
+	return FAT_SUCCESS;
+}
 
-	if( IS_POINT_ROOT_ENTRY( dir->entry ) && ( dir->fs->FATType == FAT12 || dir->fs->FATType == FAT16 ) )
-	{ //root 디렉토리인지
-		if( dir->fs->FATType != FAT32 )
-			rootEntryCount = dir->fs->bpb.rootEntryCount;
+/* A directory is read from start to end, so every cluster it moves into doubles the
+ * window. The root region is contiguous and is read ahead as far as the cache allows */
+void read_dir_ahead( FAT_DIR* cursor, SECTOR rootSectors )
+{
+	FAT_FILESYSTEM*	fs = cursor->fs;
+	DWORD			limit = get_readahead_limit( fs );
+	SECTOR			rootSector;
 
-		for( i = 0; i < rootEntryCount; i++ )
-		{
-			read_root_sector( dir->fs, i, sector );
-			location.cluster = 0; //root라서
-			location.sector = i;
-			location.number = 0;
-			if( read_dir_from_sector( dir->fs, &location, sector, adder, list ) )
-				break;
-		}
+	if( cursor->isRoot )
+	{
+		if( cursor->sector < cursor->ahead )
+			return;
+
+		rootSector = fs->bpb.reservedSectorCount + ( fs->bpb.numberOfFATs * fs->bpb.FATSize16 );
+		bcache_prefetch( &fs->cache, rootSector + cursor->sector, rootSectors - cursor->sector );
+		cursor->ahead = cursor->sector + MIN( rootSectors - cursor->sector, fs->cache.numberOfBuffers / 2 );
+		return;
+	}
+
+	if( limit == 0 )
+		return;
+
+	cursor->window = ( cursor->window ? MIN( cursor->window * 2, limit ) : MIN( READAHEAD_MIN_CLUSTERS, limit ) );
+	if( cursor->ahead > cursor->clusterIndex + cursor->window / 2 )
+		return; // 아직 충분히 앞서 있음
+
+	prefetch_clusters( fs, cursor->cluster, cursor->window ); // 이미 캐시에 있는 섹터는 건너뜀
+	cursor->ahead = cursor->clusterIndex + cursor->window;
+}
+
+/* moves to the next directory sector, reading the following ones ahead when the buffered ones are used up */
+int next_dir_sector( FAT_DIR* cursor )
+{
+	FAT_FILESYSTEM*	fs = cursor->fs;
+	SECTOR			rootSectors, count;
+	int				result;
+
+	if( cursor->index + 1 < cursor->count )
+	{
+		cursor->index++;
+		cursor->location.sector++;
+		return FAT_SUCCESS;
+	}
+
+	if( cursor->isRoot )
+	{
+		rootSectors = ( ( fs->bpb.rootEntryCount * 32 ) + ( fs->bpb.bytesPerSector - 1 ) ) / fs->bpb.bytesPerSector;
+		if( cursor->sector >= rootSectors )
+			return -2; // root 영역의 끝
+
+		read_dir_ahead( cursor, rootSectors );
+		count = MIN( DIR_READ_SECTORS, rootSectors - cursor->sector );
+		result = read_root_sectors( fs, cursor->sector, count, cursor->sectors );
 	}
 	else
-	{ //root 아니라면
-		i = GET_FIRST_CLUSTER( dir->entry );
-		do
+	{
+		if( cursor->sector == fs->bpb.sectorsPerCluster )
+		{ // 다음 cluster
+			cursor->cluster = get_fat( fs, cursor->cluster );
+			cursor->sector = 0;
+			cursor->clusterIndex++;
+			if( cursor->cluster < 2 || is_type_eoc( fs->typeInfo, cursor->cluster ) )
+				return -2; // cluster chain의 끝
+			if( cursor->clusterIndex >= fs->fatEntries )
+				return FAT_ERROR; // FAT보다 긴 체인은 순환하는 체인
+		}
+
+		if( cursor->sector == 0 )
+			read_dir_ahead( cursor, 0 );
+
+		count = MIN( DIR_READ_SECTORS, fs->bpb.sectorsPerCluster - cursor->sector );
+		result = read_data_sectors( fs, cursor->cluster, cursor->sector, count, cursor->sectors );
+	}
+
+	if( result )
+		return FAT_ERROR;
+
+	cursor->location.cluster	= cursor->cluster;
+	cursor->location.sector		= cursor->sector;
+	cursor->location.number		= 0;
+	cursor->sector				+= count;
+	cursor->count				= count;
+	cursor->index				= 0;
+
+	return FAT_SUCCESS;
+}
+
+/* Returns up to 'max' entries of the current sector, moving on to the next sector with
+ * entries in use once it is done. 0 means no entry is left, a negative value an error */
+int fat_readdir_next( FAT_DIR* cursor, FAT_DIRENT* entries, UINT32 max )
+{
+	UINT32			entriesPerSector = cursor->fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY );
+	const FAT_DIR_ENTRY*	dir;
+	DIR_SCAN_MASKS	masks;
+	UINT32			i;
+	int				filled = 0, result;
+
+	while( filled == 0 && max > 0 )
+	{
+		if( cursor->pending == 0 )
 		{
-			for( j = 0; j < dir->fs->bpb.sectorsPerCluster; j++ )
-			{
-				read_data_sector( dir->fs, i, j, sector );
-				location.cluster = i;
-				location.sector = j;
-				location.number = 0;
+			if( cursor->ended )
+				return 0;
 
-				if( read_dir_from_sector( dir->fs, &location, sector, adder, list ) )
-					break;
+			result = next_dir_sector( cursor );
+			if( result )
+			{
+				cursor->ended = 1;
+				return ( result == -2 ? 0 : FAT_ERROR );
 			}
-			i = get_fat( dir->fs, i );
-		} while( !is_EOC( dir->fs->FATType, i ) && i != 0 );
+
+			// NO_MORE 앞의 사용중인 entry만
+			scan_dir_sector( &cursor->sectors[cursor->index * cursor->fs->bpb.bytesPerSector], entriesPerSector, NULL, &masks );
+			cursor->pending = DIR_BEFORE_END( masks, DIR_ALL_ENTRIES( entriesPerSector ) ) & ~masks.freeMask;
+			cursor->ended = ( masks.endMask != 0 );
+		}
+
+		dir = ( const FAT_DIR_ENTRY* )&cursor->sectors[cursor->index * cursor->fs->bpb.bytesPerSector];
+		while( cursor->pending && filled < ( int )max )
+		{
+			i = lowest_dir_bit( cursor->pending );
+			cursor->pending &= cursor->pending - 1;
+			if( dir[i].attribute & ATTR_VOLUME_ID )
+				continue;
+
+			entries[filled].entry				= dir[i];
+			entries[filled].location			= cursor->location;
+			entries[filled].location.number	= i;
+			filled++;
+		}
 	}
 
-	return FAT_SUCCESS;
+	return filled;
+}
+
+void fat_closedir( FAT_DIR* cursor )
+{
+	cursor->pending = 0;
+	cursor->ended = 1;
 }
 
 int add_free_cluster( FAT_FILESYSTEM* fs, SECTOR cluster )
 {
-	return push_cluster( &fs->freeClusterList, cluster );
+	set_cluster_free( &fs->freeClusterMap, cluster );
+
+	return FAT_SUCCESS;
 }
 
-SECTOR alloc_free_cluster( FAT_FILESYSTEM* fs )
+/* Allocates the first free cluster at or after 'goal'. A goal of 0 continues
+ * from where the last allocation stopped (next-fit) */
+SECTOR alloc_free_cluster( FAT_FILESYSTEM* fs, SECTOR goal )
 {
-	SECTOR	cluster;
+	UINT32	cluster;
+
+	if( prepare_fat( fs ) )
+		return 0;
+
+	if( goal < 2 )
+		goal = fs->freeClusterMap.hint;
 
-	if( pop_cluster( &fs->freeClusterList, &cluster ) == FAT_ERROR )
+	if( find_free_cluster( &fs->freeClusterMap, goal, &cluster ) )
 		return 0;
+	if( cluster < 2 )
+		return 0;
+
+	set_cluster_used( &fs->freeClusterMap, cluster );
+	fs->freeClusterMap.hint = cluster + 1; // 다음 검색은 여기서부터
+	invalidate_extent_map( &fs->extentCache, cluster );
 
 	return cluster;
 }
 
-SECTOR span_cluster_chain( FAT_FILESYSTEM* fs, SECTOR clusterNumber )
+/* Allocates up to 'count' clusters as contiguous runs and links them after 'tail'
+ * (or as a new chain when tail is 0). The longest free runs are taken first, starting
+ * right after the tail. Returns the first new cluster, or 0 when nothing is free */
+SECTOR alloc_cluster_chain( FAT_FILESYSTEM* fs, SECTOR tail, UINT32 count )
 {
-	UINT32	nextCluster;
+	FAT_BATCH	batch;
+	UINT32		runStart, runLength, goal, i;
+	SECTOR		first = 0, prev = tail;
+	int			result = FAT_SUCCESS;
+
+	if( prepare_fat( fs ) )
+		return 0;
+
+	fat_batch_begin( fs, &batch );
 
-	nextCluster = alloc_free_cluster( fs );
+	goal = ( tail ? tail + 1 : fs->freeClusterMap.hint );
 
-	if( nextCluster )
+	while( count > 0 )
 	{
-		set_fat( fs, clusterNumber, nextCluster ); // 현재 cluster에 새로운 cluster 번호 set
-		set_fat( fs, nextCluster, get_MS_EOC( fs->FATType ) ); // 새로운 cluster에 EOC(End Of Cluster?) set
+		find_free_run( &fs->freeClusterMap, count, goal, &runStart, &runLength );
+		if( runLength == 0 )
+			break; // 남은 free cluster 없음
 
+		for( i = 0; i < runLength && result == FAT_SUCCESS; i++ )
+		{
+			result = fat_batch_set( &batch, runStart + i, ( i + 1 < runLength ? runStart + i + 1 : fs->typeInfo->MS_EOC ) );
+			if( result == FAT_SUCCESS )
+				set_cluster_used( &fs->freeClusterMap, runStart + i );
+		} // run 내부 연결 + EOC
+
+		if( prev && result == FAT_SUCCESS )
+			result = fat_batch_set( &batch, prev, runStart ); // 이전 run의 끝에 이어붙임
+		if( result )
+			break;
+
+		if( first == 0 )
+			first = runStart;
+
+		prev = runStart + runLength - 1;
+		goal = prev + 1;
+		count -= runLength;
+	}
+
+	if( result )
+	{
+		for( i = 0; i < batch.count; i++ ) // 연결하지 못한 cluster들은 반환
+		{
+			if( batch.updates[i].cluster != tail )
+				set_cluster_free( &fs->freeClusterMap, batch.updates[i].cluster );
+		}
+		fat_batch_abort( &batch );
+		return 0;
 	}
 
-	return nextCluster;
+	if( fat_batch_commit( &batch ) )
+		return 0;
+
+	if( first )
+		fs->freeClusterMap.hint = prev + 1;
+	if( first && tail == 0 )
+		invalidate_extent_map( &fs->extentCache, first ); // 새 체인
+
+	return first;
 }
 
-int find_entry_at_sector( const BYTE* sector, const BYTE* formattedName, UINT32 begin, UINT32 last, UINT32* number )
+SECTOR span_cluster_chain( FAT_FILESYSTEM* fs, SECTOR clusterNumber )
 {
-	// begin에서 last까지 formattedName을 가진 entry를 sector에서 검색해서 그 인덱스를 number에 저장
-	UINT32	i;
-	const FAT_DIR_ENTRY*	entry = ( FAT_DIR_ENTRY* )sector;
+	return alloc_cluster_chain( fs, clusterNumber, 1 ); // 바로 뒤 cluster를 우선 할당
+}
 
-	for( i = begin; i <= last; i++ )
-	{
-		if( formattedName == NULL )
-		{// formattedName == NULL인 경우
+/* Allocates 'count' one cluster chains, taken from free runs and ended with EOC in one
+ * FAT batch. Nothing is allocated unless all of them are */
+int alloc_free_clusters( FAT_FILESYSTEM* fs, UINT32 count, DWORD* clusters )
+{
+	FAT_BATCH	batch;
+	UINT32		runStart, runLength, goal, i, done = 0;
+	int			result = FAT_SUCCESS;
 
-			if( entry[i].name[0] != DIR_ENTRY_FREE && entry[i].name[0] != DIR_ENTRY_NO_MORE )
-			{
-				*number = i;
-				return FAT_SUCCESS;
-				// 현재 사용중인 첫번째 entry읽어옴
-			}
+	if( prepare_fat( fs ) || fs->freeClusterMap.freeCount < count )
+		return FAT_ERROR;
+
+	fat_batch_begin( fs, &batch );
+	goal = fs->freeClusterMap.hint;
+
+	while( done < count && result == FAT_SUCCESS )
+	{
+		find_free_run( &fs->freeClusterMap, count - done, goal, &runStart, &runLength );
+		if( runLength == 0 )
+		{
+			result = FAT_ERROR;
+			break;
 		}
-		else 
-		{ // formattedName을 가진 경우
-			if( ( formattedName[0] == DIR_ENTRY_FREE || formattedName[0] == DIR_ENTRY_NO_MORE ) &&
-				( formattedName[0] == entry[i].name[0] ) )
-			{ 
-				// 새로운 dir_entry 추가할 때 추가될 dir_entry의 위치 찾음
-				// entry[i]와 formattedName을 비교해서 동일하면 
-				*number = i;
-				return FAT_SUCCESS;
-			}
 
-			if( memcmp( entry[i].name, formattedName, MAX_ENTRY_NAME_LENGTH ) == 0 )
+		for( i = 0; i < runLength && result == FAT_SUCCESS; i++ )
+		{
+			result = fat_batch_set( &batch, runStart + i, fs->typeInfo->MS_EOC );
+			if( result == FAT_SUCCESS )
 			{
-				// entry name을 검색할 때 해당 dir_entry를 찾은 경우
-				// entry[i]와 formattedName을 비교해서 동일하면 
-				*number = i;
-				return FAT_SUCCESS;
+				set_cluster_used( &fs->freeClusterMap, runStart + i );
+				invalidate_extent_map( &fs->extentCache, runStart + i );
+				clusters[done++] = runStart + i;
 			}
 		}
+		goal = runStart + runLength;
+	}
 
-		if( entry[i].name[0] == DIR_ENTRY_NO_MORE )
-		{
-			// dir_entry의 끝 -> 검색 중지, 해당 위치 number에 저장
-			// null 로 검색할 경우 && dir_entry 배열이 비어있는 경우
-			*number = i;
-			return -2;
-		}
+	if( result == FAT_SUCCESS )
+		result = fat_batch_commit( &batch );
+	else
+		fat_batch_abort( &batch );
+
+	if( result )
+	{
+		for( i = 0; i < done; i++ ) // 할당한 cluster 반환
+			set_cluster_free( &fs->freeClusterMap, clusters[i] );
+		return FAT_ERROR;
+	}
+
+	fs->freeClusterMap.hint = goal;
+
+	return FAT_SUCCESS;
+}
+
+int find_entry_at_sector( const BYTE* sector, const BYTE* formattedName, UINT32 begin, UINT32 last, UINT32* number )
+{
+	// begin에서 last까지 formattedName을 가진 entry를 sector에서 검색해서 그 인덱스를 number에 저장
+	DIR_SCAN_MASKS	masks;
+	UINT32			range, hits, end;
+
+	if( begin > last )
+	{
+		*number = begin;
+		return -1;
+	}
+
+	// FREE, NO_MORE로 검색하는 경우 이름은 비교하지 않음
+	if( formattedName && ( formattedName[0] == DIR_ENTRY_FREE || formattedName[0] == DIR_ENTRY_NO_MORE ) )
+		scan_dir_sector( sector, last + 1, NULL, &masks );
+	else
+		scan_dir_sector( sector, last + 1, formattedName, &masks );
+
+	if( formattedName == NULL )
+		hits = ~( masks.freeMask | masks.endMask );	// 현재 사용중인 entry
+	else if( formattedName[0] == DIR_ENTRY_FREE )
+		hits = masks.freeMask;						// 새로운 dir_entry 추가할 위치
+	else if( formattedName[0] == DIR_ENTRY_NO_MORE )
+		hits = masks.endMask;
+	else
+		hits = masks.matchMask;						// 이름으로 검색
+
+	range = DIR_ALL_ENTRIES( last + 1 ) & ~DIR_ALL_ENTRIES( begin );
+	end = masks.endMask & range;
+	hits &= range & ( DIR_BEFORE_END( masks, 0xFFFFFFFFu ) | end ); // NO_MORE 뒤는 보지 않음
+
+	if( hits )
+	{
+		*number = lowest_dir_bit( hits );
+		return FAT_SUCCESS;
+	}
+
+	if( end )
+	{
+		// dir_entry의 끝 -> 검색 중지, 해당 위치 number에 저장
+		*number = lowest_dir_bit( end );
+		return -2;
 	}
 
-	*number = i;
+	*number = last + 1;
 	return -1;
 }
 
@@ -996,7 +1722,7 @@ int find_entry_on_data( FAT_FILESYSTEM* fs, const FAT_ENTRY_LOCATION* first, con
 		nextCluster = get_fat( fs, currentCluster );
 		// 다음 sector 검색 위해 currentcluster에 대응하는 FATable entry를 얻어옴
 
-		if( is_EOC( fs->FATType, nextCluster ) )
+		if( is_type_eoc( fs->typeInfo, nextCluster ) )
 		// nextCluster가 EOC인 경우
 			break;
 		else if( nextCluster == 0)
@@ -1027,50 +1753,456 @@ int lookup_entry( FAT_FILESYSTEM* fs, const FAT_ENTRY_LOCATION* first, const BYT
 		return find_entry_on_data( fs, first, entryName, ret ); //그 외 데이터에서 entry찾기
 }
 
-int set_entry( FAT_FILESYSTEM* fs, const FAT_ENTRY_LOCATION* location, const FAT_DIR_ENTRY* value )
+/* reads the directory entry at 'location' */
+int read_entry( FAT_FILESYSTEM* fs, const FAT_ENTRY_LOCATION* location, FAT_DIR_ENTRY* entry )
 {
-	// data영역(cluster 단위로 관리) location 위치에 dir_entry 저장
-	// 실제 data영역(disk)에 구조체 정보를 저장하는 단계
 	BYTE	sector[MAX_SECTOR_SIZE];
-	FAT_DIR_ENTRY*	entry;
 
-	
 	if( location->cluster == 0 && ( fs->FATType == FAT12 || fs->FATType == FAT16 ) )
-	{ //location이 root디렉토리 영역일 경우
-		/* 
-		디스크에는 오직 sector 단위로만 읽고 쓰기가 가능하기 때문에 쓰고자 하는 sector를 전부 버퍼에 읽고, 
-		특정 영역을 버퍼에서 변경한 뒤, 다시 디스크의 sector에 써주는 식으로 write를 해야 한다.
-		읽어오는 과정 없이는 바꾸고자 하는 부분을 제외한 나머지 부분의 데이터를 모르기 때문에 write를 하면 변경한 부분을 제외한 나머지 부분이 원하지 않게 변경된다.
-		*/
-		read_root_sector( fs, location->sector, sector );
-		//sector에 루트 디렉토리 위치 가져옴
-
-		entry = ( FAT_DIR_ENTRY* )sector;
-		entry[location->number] = *value;
-		//location->number위치에 value 추가
-		write_root_sector( fs, location->sector, sector );
-		// 
+	{
+		if( read_root_sector( fs, location->sector, sector ) )
+			return FAT_ERROR;
 	}
-	else
-	{ //location이 root디렉토리 영역이 아닐 경우
-		read_data_sector( fs, location->cluster, location->sector, sector );
-		// read_root_sector가 아닌 read_data_sector를 사용하여 0이 아닌 cluster에 접근
+	else if( read_data_sector( fs, location->cluster, location->sector, sector ) )
+		return FAT_ERROR;
 
-		entry = ( FAT_DIR_ENTRY* )sector;
-		entry[location->number] = *value;
+	*entry = ( ( FAT_DIR_ENTRY* )sector )[location->number];
 
-		write_data_sector( fs, location->cluster, location->sector, sector );
-	}
+	return FAT_SUCCESS;
+}
 
-	return FAT_ERROR;
+/******************************************************************************/
+/* Directory slot scan                                                        */
+/******************************************************************************/
+/* entries which fat_readdir_next reports, and so the ones a name index holds */
+int is_indexed_entry( const FAT_DIR_ENTRY* entry )
+{
+	return entry->name[0] != DIR_ENTRY_FREE && entry->name[0] != DIR_ENTRY_NO_MORE && !( entry->attribute & ATTR_VOLUME_ID );
 }
 
-int insert_entry( const FAT_NODE* parent, FAT_NODE* newEntry, BYTE overwrite )
+/* Checks one sector of directory entries, returns nonzero when the scan can stop. With an
+ * index, every name and every free entry of the sector is added to it */
+int scan_slots_in_sector( FAT_FILESYSTEM* fs, const FAT_ENTRY_LOCATION* location, const BYTE* sector, const BYTE* formattedName, FAT_DIR_SLOTS* slots, DIR_INDEX* index )
+{
+	const FAT_DIR_ENTRY*	entry = ( const FAT_DIR_ENTRY* )sector;
+	UINT32					i, entriesPerSector = fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY );
+	DIR_SCAN_MASKS			masks;
+	UINT32					stop, first, seen, holes;
+
+	scan_dir_sector( sector, entriesPerSector, formattedName, &masks );
+
+	// 끝 표시나 같은 이름에서 멈춤
+	stop = masks.endMask | ( masks.matchMask & ~masks.freeMask );
+	first = stop & ( 0u - stop );
+	seen = ( stop ? first - 1 : DIR_ALL_ENTRIES( entriesPerSector ) );
+	if( first & ~masks.endMask )
+		seen |= first; // 같은 이름의 entry까지는 읽은 것
+	holes = masks.freeMask & seen;
+
+	if( index && index->loaded )
+	{
+		for( ; seen; seen &= seen - 1 )
+		{
+			i = lowest_dir_bit( seen );
+			if( ( holes >> i ) & 1 ?
+				push_dir_index_hole( index, location->cluster, location->sector, i ) :
+				is_indexed_entry( &entry[i] ) && insert_dir_index( index, entry[i].name, location->cluster, location->sector, i ) )
+			{
+				index->loaded = 0; // 메모리 부족, 다 읽은 뒤 버림
+				break;
+			}
+		}
+	}
+
+	if( holes && !slots->hasFree )
+	{ // 처음 만난 빈 entry
+		slots->hasFree = 1;
+		slots->freeSlot = *location;
+		slots->freeSlot.number = lowest_dir_bit( holes );
+	}
+
+	if( stop == 0 )
+		return 0;
+
+	i = lowest_dir_bit( first );
+	if( first & masks.endMask )
+	{
+		slots->hasEnd = 1;
+		slots->end = *location;
+		slots->end.number = i;
+		return -1; // 뒤로는 entry가 없음
+	}
+
+	slots->found = 1;
+	slots->match = *location;
+	slots->match.number = i;
+	return -1; // 이름 충돌
+}
+
+/* One pass over a directory for a create: whether 'formattedName' (NULL to skip the
+ * check) is in it already, the first free entry and the end of entries marker.
+ * The same pass builds the name index of the directory if 'index' is given */
+int scan_dir_slots( const FAT_NODE* dir, const BYTE* formattedName, FAT_DIR_SLOTS* slots, DIR_INDEX* index )
+{
+	BYTE	sectors[MAX_SECTOR_SIZE * DIR_READ_SECTORS];
+	FAT_FILESYSTEM*	fs = dir->fs;
+	UINT32	bytesPerSector = fs->bpb.bytesPerSector;
+	SECTOR	i, k, count, rootSectors;
+	DWORD	cluster, chainLength = 0;
+	FAT_ENTRY_LOCATION	location;
+
+	ZeroMemory( slots, sizeof( FAT_DIR_SLOTS ) );
+	location.number = 0;
+
+	if( IS_POINT_ROOT_ENTRY( dir->entry ) && ( fs->FATType == FAT12 || fs->FATType == FAT16 ) )
+	{ // root 영역은 rootEntryCount까지만
+		rootSectors = ( ( fs->bpb.rootEntryCount * 32 ) + ( bytesPerSector - 1 ) ) / bytesPerSector;
+		location.cluster = 0;
+
+		for( i = 0; i < rootSectors; i += count )
+		{
+			count = MIN( DIR_READ_SECTORS, rootSectors - i );
+			if( read_root_sectors( fs, i, count, sectors ) )
+				return FAT_ERROR;
+
+			for( k = 0; k < count; k++ )
+			{
+				location.sector = i + k;
+				if( scan_slots_in_sector( fs, &location, &sectors[k * bytesPerSector], formattedName, slots, index ) )
+					return FAT_SUCCESS;
+			}
+		}
+
+		return FAT_SUCCESS;
+	}
+
+	cluster = GET_FIRST_CLUSTER( dir->entry );
+	while( !is_type_eoc( fs->typeInfo, cluster ) && cluster >= 2 && cluster < fs->fatEntries && chainLength++ < fs->fatEntries )
+	{
+		location.cluster = cluster;
+
+		for( i = 0; i < fs->bpb.sectorsPerCluster; i += count )
+		{ // 클러스터를 DIR_READ_SECTORS 단위로 한번에 읽음
+			count = MIN( DIR_READ_SECTORS, fs->bpb.sectorsPerCluster - i );
+			if( read_data_sectors( fs, cluster, i, count, sectors ) )
+				return FAT_ERROR;
+
+			for( k = 0; k < count; k++ )
+			{
+				location.sector = i + k;
+				if( scan_slots_in_sector( fs, &location, &sectors[k * bytesPerSector], formattedName, slots, index ) )
+					return FAT_SUCCESS;
+			}
+		}
+
+		cluster = get_fat( fs, cluster );
+	}
+
+	return FAT_SUCCESS;
+}
+
+/******************************************************************************/
+/* Directory name index                                                       */
+/******************************************************************************/
+/* the key of a directory in the name index, the same cluster lookup_entry starts from */
+DWORD get_dir_cluster( const FAT_NODE* dir )
+{
+	if( IS_POINT_ROOT_ENTRY( dir->entry ) )
+		return 0;
+
+	return GET_FIRST_CLUSTER( dir->entry );
+}
+
+/* Returns the name index of a directory, reading the whole directory once to build it.
+ * The index also keeps the free entries and the end marker for inserts */
+DIR_INDEX* get_dir_index( const FAT_NODE* dir )
+{
+	DWORD			dirCluster = get_dir_cluster( dir );
+	DIR_INDEX*		index;
+	FAT_DIR_SLOTS	slots;
+
+	index = find_dir_index( &dir->fs->dirIndex, dirCluster );
+	if( index )
+		return index;
+
+	index = new_dir_index( &dir->fs->dirIndex, dirCluster );
+	if( scan_dir_slots( dir, NULL, &slots, index ) || !index->loaded )
+	{
+		invalidate_dir_index( &dir->fs->dirIndex, dirCluster );
+		return NULL;
+	}
+
+	reverse_dir_index_holes( index ); // 앞쪽 빈 entry부터 사용
+	index->hasEnd		= slots.hasEnd;
+	index->end.cluster	= slots.end.cluster;
+	index->end.sector	= slots.end.sector;
+	index->end.number	= slots.end.number;
+
+	return index;
+}
+
+/* Finds the slots for a create through the name index, without reading the directory
+ * once it is indexed. Falls back to scan_dir_slots if the index cannot be built */
+int find_dir_slots( const FAT_NODE* dir, const BYTE* formattedName, FAT_DIR_SLOTS* slots )
+{
+	DIR_INDEX*		index = get_dir_index( dir );
+	DIR_INDEX_SLOT*	slot;
+
+	if( index == NULL )
+		return scan_dir_slots( dir, formattedName, slots, NULL );
+
+	ZeroMemory( slots, sizeof( FAT_DIR_SLOTS ) );
+
+	slot = ( formattedName ? lookup_dir_index( index, formattedName ) : NULL );
+	if( slot )
+	{
+		slots->found			= 1;
+		slots->match.cluster	= slot->cluster;
+		slots->match.sector		= slot->sector;
+		slots->match.number		= slot->number;
+		return FAT_SUCCESS;
+	}
+
+	if( index->holeCount )
+	{ // 가장 최근에 알게 된 빈 entry
+		slots->hasFree			= 1;
+		slots->freeSlot.cluster	= index->holes[index->holeCount - 1].cluster;
+		slots->freeSlot.sector	= index->holes[index->holeCount - 1].sector;
+		slots->freeSlot.number	= index->holes[index->holeCount - 1].number;
+	}
+
+	if( index->hasEnd )
+	{
+		slots->hasEnd		= 1;
+		slots->end.cluster	= index->end.cluster;
+		slots->end.sector	= index->end.sector;
+		slots->end.number	= index->end.number;
+	}
+
+	return FAT_SUCCESS;
+}
+
+/* Finds 'formattedName' in the directory through its name index. The linear search
+ * is used when the index cannot be built or does not match the disk */
+int search_entry_by_name( FAT_NODE* parent, const BYTE* formattedName, FAT_NODE* ret )
+{
+	FAT_ENTRY_LOCATION	location;
+	FAT_DIR_ENTRY		entry;
+	DIR_INDEX*			index;
+	DIR_INDEX_SLOT*		slot;
+
+	index = get_dir_index( parent );
+	if( index )
+	{
+		slot = lookup_dir_index( index, formattedName );
+		if( slot == NULL )
+			return FAT_ERROR;
+
+		location.cluster	= slot->cluster;
+		location.sector		= slot->sector;
+		location.number		= slot->number;
+		if( read_entry( parent->fs, &location, &entry ) == FAT_SUCCESS &&
+			memcmp( entry.name, formattedName, MAX_ENTRY_NAME_LENGTH ) == 0 )
+		{
+			ret->fs = parent->fs;
+			ret->entry = entry;
+			ret->location = location;
+			return FAT_SUCCESS;
+		}
+
+		invalidate_dir_index( &parent->fs->dirIndex, index->dirCluster ); // index가 disk와 어긋남
+	}
+
+	location.cluster = get_dir_cluster( parent );
+	location.sector = 0;
+	location.number = 0;
+
+	return lookup_entry( parent->fs, &location, formattedName, ret );
+}
+
+/* Looks 'formattedName' up in the dentry cache first, a hit does not touch the disk.
+ * A miss is cached as a negative entry only when the name index answered it */
+int find_entry_by_name( FAT_NODE* parent, const BYTE* formattedName, FAT_NODE* ret )
+{
+	FAT_DENTRY_CACHE*	cache = &parent->fs->dentryCache;
+	DWORD				dirCluster = get_dir_cluster( parent );
+	FAT_DENTRY*			dentry;
+	int					result;
+
+	dentry = lookup_dentry( cache, dirCluster, formattedName );
+	if( dentry )
+	{
+		if( dentry->state == DENTRY_NEGATIVE )
+			return FAT_ERROR;
+
+		ret->fs = parent->fs;
+		ret->entry = dentry->entry;
+		ret->location = dentry->location;
+		return FAT_SUCCESS;
+	}
+
+	result = search_entry_by_name( parent, formattedName, ret );
+	if( result == FAT_SUCCESS )
+		add_dentry( cache, dirCluster, formattedName, ret );
+	else if( find_dir_index( &parent->fs->dirIndex, dirCluster ) )
+		add_dentry( cache, dirCluster, formattedName, NULL ); // 없는 이름도 기억
+
+	return result;
+}
+
+/* keeps the name indexes in step with an entry which set_entry overwrote */
+void update_dir_index( FAT_FILESYSTEM* fs, const FAT_ENTRY_LOCATION* location, const FAT_DIR_ENTRY* oldEntry, const FAT_DIR_ENTRY* newEntry )
+{
+	update_dentry_location( &fs->dentryCache, location, newEntry );
+
+	if( !is_indexed_entry( oldEntry ) || memcmp( oldEntry->name, newEntry->name, MAX_ENTRY_NAME_LENGTH ) == 0 )
+		return; // 새 entry는 insert_entry가 추가
+
+	rename_dir_index( &fs->dirIndex, oldEntry->name, ( is_indexed_entry( newEntry ) ? newEntry->name : NULL ),
+					  location->cluster, location->sector, location->number );
+}
+
+/* Adds an entry stored by insert_entry to the index of its directory, if it has one.
+ * The free entry it took is forgotten and the end marker follows 'after' */
+void index_new_entry( const FAT_NODE* parent, const FAT_NODE* newEntry, const FAT_DIR_SLOTS* after )
+{
+	DWORD		dirCluster = get_dir_cluster( parent );
+	DIR_INDEX*	index;
+
+	drop_dentry( &parent->fs->dentryCache, dirCluster, newEntry->entry.name ); // 없다고 기억한 이름일 수 있음
+
+	index = find_dir_index( &parent->fs->dirIndex, dirCluster );
+	if( index == NULL )
+		return;
+
+	take_dir_index_hole( index, newEntry->location.cluster, newEntry->location.sector, newEntry->location.number );
+	index->hasEnd		= after->hasEnd;
+	index->end.cluster	= after->end.cluster;
+	index->end.sector	= after->end.sector;
+	index->end.number	= after->end.number;
+
+	if( is_indexed_entry( &newEntry->entry ) && insert_dir_index( index, newEntry->entry.name, newEntry->location.cluster,
+																  newEntry->location.sector, newEntry->location.number ) )
+		invalidate_dir_index( &parent->fs->dirIndex, dirCluster );
+}
+
+int set_entry( FAT_FILESYSTEM* fs, const FAT_ENTRY_LOCATION* location, const FAT_DIR_ENTRY* value )
+{
+	// data영역(cluster 단위로 관리) location 위치에 dir_entry 저장
+	// 실제 data영역(disk)에 구조체 정보를 저장하는 단계
+	BYTE	sector[MAX_SECTOR_SIZE];
+	FAT_DIR_ENTRY*	entry;
+	FAT_DIR_ENTRY	oldEntry;
+	int		result;
+
+	
+	if( location->cluster == 0 && ( fs->FATType == FAT12 || fs->FATType == FAT16 ) )
+	{ //location이 root디렉토리 영역일 경우
+		/* 
+		디스크에는 오직 sector 단위로만 읽고 쓰기가 가능하기 때문에 쓰고자 하는 sector를 전부 버퍼에 읽고, 
+		특정 영역을 버퍼에서 변경한 뒤, 다시 디스크의 sector에 써주는 식으로 write를 해야 한다.
+		읽어오는 과정 없이는 바꾸고자 하는 부분을 제외한 나머지 부분의 데이터를 모르기 때문에 write를 하면 변경한 부분을 제외한 나머지 부분이 원하지 않게 변경된다.
+		*/
+		if( read_root_sector( fs, location->sector, sector ) )
+			return FAT_ERROR;
+		//sector에 루트 디렉토리 위치 가져옴
+
+		entry = ( FAT_DIR_ENTRY* )sector;
+		oldEntry = entry[location->number];
+		entry[location->number] = *value;
+		//location->number위치에 value 추가
+		result = write_root_sector( fs, location->sector, sector );
+	}
+	else
+	{ //location이 root디렉토리 영역이 아닐 경우
+		if( read_data_sector( fs, location->cluster, location->sector, sector ) )
+			return FAT_ERROR;
+		// read_root_sector가 아닌 read_data_sector를 사용하여 0이 아닌 cluster에 접근
+
+		entry = ( FAT_DIR_ENTRY* )sector;
+		oldEntry = entry[location->number];
+		entry[location->number] = *value;
+
+		result = write_data_sector( fs, location->cluster, location->sector, sector );
+	}
+
+	if( result == FAT_SUCCESS )
+		update_dir_index( fs, location, &oldEntry, value ); // 이름이 바뀌거나 지워졌으면 index에 반영
+
+	return result;
+}
+
+/* Stores a new entry in the free entry found by find_dir_slots, or at the end of entries
+ * marker which then moves one entry further, into a new cluster if the current one is full */
+int insert_entry_at( const FAT_NODE* parent, FAT_NODE* newEntry, const FAT_DIR_SLOTS* slots )
+{
+	FAT_FILESYSTEM*		fs = parent->fs;
+	FAT_DIR_ENTRY		entryNoMore;
+	FAT_ENTRY_LOCATION	next;
+	FAT_DIR_SLOTS		after = *slots; // insert 뒤의 end marker
+	UINT32				entriesPerSector = fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY );
+	int					isRoot = IS_POINT_ROOT_ENTRY( parent->entry ) && ( fs->FATType == FAT12 || fs->FATType == FAT16 );
+
+	if( slots->hasFree )
+	{ // 지워진 entry 재사용
+		if( set_entry( fs, &slots->freeSlot, &newEntry->entry ) )
+			return FAT_ERROR;
+		newEntry->location = slots->freeSlot;
+	}
+	else
+	{
+		if( !slots->hasEnd )
+		{ // root 영역이 가득 참, 또는 end marker가 없는 디렉토리
+			if( isRoot )
+				WARNING( "Cannot insert entry into the root entry\n" );
+			else
+				WARNING( "Cannot insert entry into the directory\n" );
+			return FAT_ERROR;
+		}
+
+		next = slots->end;
+		next.number++;
+		if( next.number == entriesPerSector )
+		{ // 다음 sector
+			next.sector++;
+			next.number = 0;
+		}
+
+		if( !isRoot && next.sector == fs->bpb.sectorsPerCluster )
+		{ // cluster를 넘어가면 cluster chain을 확장
+			next.cluster = span_cluster_chain( fs, next.cluster );
+			if( next.cluster == 0 )
+			{
+				NO_MORE_CLUSER();
+				return FAT_ERROR;
+			}
+			next.sector = 0;
+		}
+
+		if( set_entry( fs, &slots->end, &newEntry->entry ) )
+			return FAT_ERROR;
+		newEntry->location = slots->end;
+
+		/* End of entries를 다음 위치에 저장, root 영역의 끝이면 marker 없이 끝남 */
+		ZeroMemory( &entryNoMore, sizeof( FAT_DIR_ENTRY ) );
+		entryNoMore.name[0] = DIR_ENTRY_NO_MORE;
+		after.hasEnd = !( isRoot && next.sector * entriesPerSector + next.number >= fs->bpb.rootEntryCount );
+		after.end = next;
+		if( after.hasEnd )
+			set_entry( fs, &next, &entryNoMore );
+	}
+
+	index_new_entry( parent, newEntry, &after ); // parent의 name index에 추가
+
+	return FAT_SUCCESS;
+}
+
+int insert_entry( const FAT_NODE* parent, FAT_NODE* newEntry, BYTE overwrite )
 {
 	//부모 디렉토리 아래에 새로운 dir_entry추가
 	FAT_ENTRY_LOCATION	begin; // 새로운 dir
 	FAT_NODE			entryNoMore;
-	BYTE				entryName[2] = { 0, };
+	FAT_DIR_SLOTS		slots;
 
 	begin.cluster = GET_FIRST_CLUSTER( parent->entry );
 	begin.sector = 0;
@@ -1101,81 +2233,19 @@ int insert_entry( const FAT_NODE* parent, FAT_NODE* newEntry, BYTE overwrite )
 		set_entry( parent->fs, &begin, &entryNoMore.entry );
 		// 다음 영역에 &entryNoMore.entry을 set
 		
+		ZeroMemory( &slots, sizeof( FAT_DIR_SLOTS ) );
+		slots.hasEnd = 1;
+		slots.end = begin;
+		index_new_entry( parent, newEntry, &slots );
 
 		return FAT_SUCCESS;
 	}
 
-	/* find empty(unused) entry, overwrite가 아닌 경우, parent 디렉토리에서 빈 entry를 찾아야 한다. */
-	entryName[0] = DIR_ENTRY_FREE;
-	if( lookup_entry( parent->fs, &begin, entryName, &entryNoMore ) == FAT_SUCCESS )
-	{ // 빈 entry찾은 경우
-		set_entry( parent->fs, &entryNoMore.location, &newEntry->entry );
-		//entryNoMore.location에 newEntry->entry를 set
-		newEntry->location = entryNoMore.location;
-	}
-	else 
-	{ // 못 찾은 경우
-		if( IS_POINT_ROOT_ENTRY( parent->entry ) && ( parent->fs->FATType == FAT12 || parent->fs->FATType == FAT16 ) )
-		{
-			// root entry이면 
-			// dir_entry 개수를 구한 후 root 디렉토리의 최대치보다 크다면 에러
-			UINT32	rootEntryCount = newEntry->location.sector * ( parent->fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY ) ) + newEntry->location.number;
-			if( rootEntryCount >= parent->fs->bpb.rootEntryCount )
-			{
-				WARNING( "Cannot insert entry into the root entry\n" );
-				return FAT_ERROR;
-			}
-		}
-
-		/* 
-		add new entry to end 
-		free 상태의 entry를 찾지 못한 경우, 가장 마지막, 즉 DIR_ENTRY_NO_MORE을 나타내던 디렉토리 엔트리에 insert되어야함.
-		이때 DIR_ENTRY_NO_MORE 디렉토리 엔트리를 추가해야함.
-		*/
-		entryName[0] = DIR_ENTRY_NO_MORE;
-		if( lookup_entry( parent->fs, &begin, entryName, &entryNoMore ) == FAT_ERROR ) //DIR_ENTRY_NO_MORE를 찾지 못한 경우
-			return FAT_ERROR;
-
-		// 찾은 경우
-
-		set_entry( parent->fs, &entryNoMore.location, &newEntry->entry );
-		newEntry->location = entryNoMore.location;
-		// entryNoMore.location에서 정보 가져옴
-		
-		entryNoMore.location.number++;
-		// DIR_ENTRY_NO_MORE를 추가하기 위함
-
-		if( entryNoMore.location.number == ( parent->fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY ) ) )
-		{ // 추가하려는 number가 sector에 저장될 수 있는 디렉토리 엔트리의 최대 개수를 넘었으면
-
-			entryNoMore.location.sector++;
-			entryNoMore.location.number = 0;
-			// 그 다음 sector에 저장되도록 한다.
-
-			if( entryNoMore.location.sector == parent->fs->bpb.sectorsPerCluster )
-			{ // sector가 주어진 cluster에 저장될 수 있는 최대 sector를 넘었으면
-				if( !( IS_POINT_ROOT_ENTRY( parent->entry ) && ( parent->fs->FATType == FAT12 || parent->fs->FATType == FAT16 ) ) )
-				{ // root디렉토리가 아닐 경우
-
-					entryNoMore.location.cluster = span_cluster_chain( parent->fs, entryNoMore.location.cluster );
-					// cluster chain을 확장하여 그 다음 cluster인덱스를 받고
-
-					if( entryNoMore.location.cluster == 0 )
-					{ // 확장 실패시 에러 출력
-						NO_MORE_CLUSER();
-						return FAT_ERROR;
-					}
-
-					entryNoMore.location.sector = 0; // 확장 성공시 첫 sector로 설정
-				}
-			}
-		}
-
-		/* End of entries를 정해진 위치에 저장 */
-		set_entry( parent->fs, &entryNoMore.location, &entryNoMore.entry );
-	}
+	/* find empty(unused) entry, overwrite가 아닌 경우, parent 디렉토리를 한번 읽으면서 빈 entry와 끝을 같이 찾음 */
+	if( find_dir_slots( parent, NULL, &slots ) )
+		return FAT_ERROR;
 
-	return FAT_SUCCESS;
+	return insert_entry_at( parent, newEntry, &slots );
 }
 
 void upper_string( char* str, int length )
@@ -1260,6 +2330,7 @@ int format_name( FAT_FILESYSTEM* fs, char* name )
 int fat_mkdir( const FAT_NODE* parent, const char* entryName, FAT_NODE* ret )
 {
 	FAT_NODE		dotNode, dotdotNode;
+	FAT_DIR_SLOTS	slots;
 	DWORD			firstCluster; 
 	BYTE			name[MAX_NAME_LENGTH];
 	int				result;
@@ -1269,11 +2340,14 @@ int fat_mkdir( const FAT_NODE* parent, const char* entryName, FAT_NODE* ret )
 	if( format_name( parent->fs, name ) ) // 입력받은 name을 파일시스템에 맞게 검사 및 변형
 		return FAT_ERROR;
 
+	if( find_dir_slots( parent, name, &slots ) || slots.found ) // 같은 이름 검사와 넣을 자리 찾기를 한번에
+		return FAT_ERROR;
+
 	/* newEntry */
 	ZeroMemory( ret, sizeof( FAT_NODE ) );
 	memcpy( ret->entry.name, name, MAX_ENTRY_NAME_LENGTH ); // 이름 설정
 	ret->entry.attribute = ATTR_DIRECTORY; // 용도를 디렉토리로 설정
-	firstCluster = alloc_free_cluster( parent->fs ); //freecluster 할당
+	firstCluster = alloc_free_cluster( parent->fs, 0 ); //freecluster 할당
 	// newEntry<ret>에 entryName,attribute을 등록, firstcluster가져오기
 
 	if( firstCluster == 0 )
@@ -1282,10 +2356,11 @@ int fat_mkdir( const FAT_NODE* parent, const char* entryName, FAT_NODE* ret )
 		return FAT_ERROR;
 	}
 	
-	set_fat( parent->fs, firstCluster, get_MS_EOC( parent->fs->FATType ) ); 
+	set_fat( parent->fs, firstCluster, parent->fs->typeInfo->MS_EOC ); 
+	purge_dentry_dir( &parent->fs->dentryCache, firstCluster ); // 재사용된 cluster에 남은 이름은 버림
 	// FATable에 해당 클러스터 FATentry를 EOC로 바꿈         //get_MS_EOC : FAT시스템에 맞는 EOC호출
 	SET_FIRST_CLUSTER( ret->entry, firstCluster ); // ret->entry의 firstClusterLO에 firstcluster변수<할당 받은 클러스터>를 등록
-	result = insert_entry( parent, ret, 0 ); // parent아래에 ret삽입
+	result = insert_entry_at( parent, ret, &slots ); // parent아래에 ret삽입
 	if( result )
 		return FAT_ERROR;
 
@@ -1308,26 +2383,38 @@ int fat_mkdir( const FAT_NODE* parent, const char* entryName, FAT_NODE* ret )
 	dotdotNode.entry.attribute = ATTR_DIRECTORY;
 	SET_FIRST_CLUSTER( dotdotNode.entry, GET_FIRST_CLUSTER( parent->entry ) );
 	// dotdotNode.entry<상위폴더위치>의 irstClusterLO에 firstcluster변수<할당 받은 클러스터>를 등록
-	insert_entry( ret, &dotdotNode, 0 ); // ret아래에 .. 삽입
+	// . 바로 뒤가 end marker이므로 새 디렉토리를 읽어 name index를 만들지 않고 삽입
+	ZeroMemory( &slots, sizeof( FAT_DIR_SLOTS ) );
+	slots.hasEnd = 1;
+	slots.end = dotNode.location;
+	slots.end.number++;
+	insert_entry_at( ret, &dotdotNode, &slots ); // ret아래에 .. 삽입
 
 	return FAT_SUCCESS;
 }
-// 클러스터체인 따라가면서 eoc나올때까지 cluster 지워주고, freeclusterlist에 추가
+// 클러스터체인 따라가면서 eoc나올때까지 cluster 지워주고, free bitmap에 표시
 int free_cluster_chain( FAT_FILESYSTEM* fs, DWORD firstCluster )
 {
-	DWORD	currentCluster = firstCluster;
-	DWORD	nextCluster;
+	const FAT_TYPE_INFO*	type = fs->typeInfo;
+	FAT_BATCH	batch;
+	DWORD		currentCluster = firstCluster;
+	DWORD		count = 0;
 
-	while( !is_EOC( fs->FATType, currentCluster ) && currentCluster != FREE_CLUSTER )
+	invalidate_extent_map( &fs->extentCache, firstCluster );
+	fat_batch_begin( fs, &batch );
+
+	while( !is_type_eoc( type, currentCluster ) && currentCluster != FREE_CLUSTER && count++ < fs->fatEntries )
 	{
-		// 클러스터체인 따라가면서 eoc나올때까지 cluster 지워주고, freeclusterlist에 추가
-		nextCluster = get_fat( fs, currentCluster );
-		set_fat( fs, currentCluster, FREE_CLUSTER );
-		add_free_cluster( fs, currentCluster );
-		currentCluster = nextCluster;
+		// 클러스터체인 따라가면서 eoc나올때까지 free로 모아두고 한번에 반영
+		if( fat_batch_set( &batch, currentCluster, FREE_CLUSTER ) )
+		{
+			fat_batch_abort( &batch );
+			return FAT_ERROR;
+		}
+		currentCluster = get_fat( fs, currentCluster );
 	}
 
-	return FAT_SUCCESS;
+	return fat_batch_commit( &batch ); // free bitmap에도 표시
 }
 
 int has_sub_entries( FAT_FILESYSTEM* fs, const FAT_DIR_ENTRY* entry )
@@ -1356,7 +2443,9 @@ int fat_rmdir( FAT_NODE* dir )
 		return FAT_ERROR;
 
 	dir->entry.name[0] = DIR_ENTRY_FREE; // 이름 초기화
-	set_entry( dir->fs, &dir->location, &dir->entry ); //초기화한거 disk에 set
+	set_entry( dir->fs, &dir->location, &dir->entry ); //초기화한거 disk에 set, parent의 index에서도 빠짐
+	invalidate_dir_index( &dir->fs->dirIndex, GET_FIRST_CLUSTER( dir->entry ) ); // 지운 디렉토리의 index 버림
+	purge_dentry_dir( &dir->fs->dentryCache, GET_FIRST_CLUSTER( dir->entry ) );
 	free_cluster_chain( dir->fs, GET_FIRST_CLUSTER( dir->entry ) ); // cluster에서 초기화
 
 	return FAT_SUCCESS;
@@ -1367,22 +2456,79 @@ int fat_rmdir( FAT_NODE* dir )
 /******************************************************************************/
 int fat_lookup( FAT_NODE* parent, const char* entryName, FAT_NODE* retEntry )
 {
-	FAT_ENTRY_LOCATION	begin;
 	BYTE	formattedName[MAX_NAME_LENGTH] = { 0, };
 
-	begin.cluster = GET_FIRST_CLUSTER( parent->entry );
-	begin.sector = 0;
-	begin.number = 0;
-
 	strncpy( formattedName, entryName, MAX_NAME_LENGTH );
 
 	if( format_name( parent->fs, formattedName ) ) //name을 파일 시스템 형식에 맞게 고침, 대문자화, 파일명 확장자 분리
 		return FAT_ERROR;
 
-	if( IS_POINT_ROOT_ENTRY( parent->entry ) )
-		begin.cluster = 0;
+	return find_entry_by_name( parent, formattedName, retEntry ); // parent 디렉토리의 name index에서 검색
+}
+
+/******************************************************************************/
+/* Lookup path                                                                */
+/******************************************************************************/
+void get_root_node( FAT_FILESYSTEM* fs, FAT_NODE* root )
+{
+	ZeroMemory( root, sizeof( FAT_NODE ) );
+	root->fs = fs;
+	root->entry = fs->rootEntry;
+}
+
+/* Resolves a '/' separated path from 'start', or from the root if it begins with '/'.
+ * Every component is looked up through the dentry cache, so a path walked before does
+ * not touch the disk. The walk stops at the first component which is missing */
+int fat_lookup_path( const FAT_NODE* start, const char* path, FAT_NODE* retEntry )
+{
+	FAT_NODE	current, next;
+	char		component[MAX_NAME_LENGTH];
+	UINT32		length;
+
+	if( *path == '/' )
+		get_root_node( start->fs, &current );
+	else
+		current = *start;
+
+	for( ;; )
+	{
+		while( *path == '/' ) // 연속된 '/'는 하나로
+			path++;
+		if( *path == 0 )
+			break;
+
+		for( length = 0; path[length] && path[length] != '/'; length++ )
+			;
+		if( length >= MAX_NAME_LENGTH )
+			return FAT_ERROR;
+		memcpy( component, path, length );
+		component[length] = 0;
+		path += length;
+
+		if( !IS_POINT_ROOT_ENTRY( current.entry ) && !( current.entry.attribute & ATTR_DIRECTORY ) )
+			return FAT_ERROR; // 파일 아래의 경로
+
+		if( strcmp( component, "." ) == 0 )
+			continue;
+
+		if( strcmp( component, ".." ) == 0 && IS_POINT_ROOT_ENTRY( current.entry ) )
+		{
+			get_root_node( current.fs, &current ); // root의 ..는 root
+			continue;
+		}
+
+		if( fat_lookup( &current, component, &next ) )
+			return FAT_ERROR;
+
+		if( IS_POINT_ROOT_ENTRY( next.entry ) )
+			get_root_node( current.fs, &current ); // ..가 root를 가리킴
+		else
+			current = next;
+	}
 
-	return lookup_entry( parent->fs, &begin, formattedName, retEntry );
+	*retEntry = current;
+
+	return FAT_SUCCESS;
 }
 
 /******************************************************************************/
@@ -1390,7 +2536,7 @@ int fat_lookup( FAT_NODE* parent, const char* entryName, FAT_NODE* retEntry )
 /******************************************************************************/
 int fat_create( FAT_NODE* parent, const char* entryName, FAT_NODE* retEntry )
 {
-	FAT_ENTRY_LOCATION	first;
+	FAT_DIR_SLOTS		slots;
 	BYTE				name[MAX_NAME_LENGTH] = { 0, };
 	int					result;
 
@@ -1404,16 +2550,12 @@ int fat_create( FAT_NODE* parent, const char* entryName, FAT_NODE* retEntry )
 	memcpy( retEntry->entry.name, name, MAX_ENTRY_NAME_LENGTH );
 
 
-	first.cluster = parent->entry.firstClusterLO;
-	first.sector = 0;
-	first.number = 0;
-
-	if( lookup_entry( parent->fs, &first, name, retEntry ) == FAT_SUCCESS )
+	if( find_dir_slots( parent, name, &slots ) || slots.found )
 		return FAT_ERROR;
-	// entryName을 가지는 file이 parent디렉토리에 있는지 확인한다.
+	// entryName을 가지는 file이 parent디렉토리에 있는지 확인하면서 넣을 자리도 같이 찾는다.
 
 	retEntry->fs = parent->fs;
-	result = insert_entry( parent, retEntry, 0 ); // entryName을 가진 file이 parent디렉토리에 존재하지 않을 경우 파일 생성
+	result = insert_entry_at( parent, retEntry, &slots ); // entryName을 가진 file이 parent디렉토리에 존재하지 않을 경우 파일 생성
 	
 	if( result )
 		return FAT_ERROR;
@@ -1422,59 +2564,536 @@ int fat_create( FAT_NODE* parent, const char* entryName, FAT_NODE* retEntry )
 }
 
 /******************************************************************************/
-/* Read file                                                                  */
+/* Create entries in bulk                                                     */
 /******************************************************************************/
-int fat_read( FAT_NODE* file, unsigned long offset, unsigned long length, char* buffer )
+int compare_entry_locations( const void* a, const void* b )
 {
-	BYTE	sector[MAX_SECTOR_SIZE];
-	DWORD	currentOffset, currentCluster, clusterSeq = 0;
+	const FAT_ENTRY_LOCATION*	x = ( const FAT_ENTRY_LOCATION* )a;
+	const FAT_ENTRY_LOCATION*	y = ( const FAT_ENTRY_LOCATION* )b;
+
+	if( x->cluster != y->cluster )
+		return ( x->cluster < y->cluster ? -1 : 1 );
+	if( x->sector != y->sector )
+		return ( x->sector < y->sector ? -1 : 1 );
+
+	return ( x->number < y->number ? -1 : ( x->number > y->number ) );
+}
+
+int flush_dir_sector( FAT_FILESYSTEM* fs, FAT_DIR_SECTOR* buffer )
+{
+	int		result;
+
+	if( !buffer->loaded )
+		return FAT_SUCCESS;
+
+	if( buffer->cluster == 0 && ( fs->FATType == FAT12 || fs->FATType == FAT16 ) )
+		result = write_root_sector( fs, buffer->sector, buffer->data );
+	else
+		result = write_data_sector( fs, buffer->cluster, buffer->sector, buffer->data );
+
+	buffer->loaded = 0;
+
+	return result;
+}
+
+/* Makes 'buffer' hold the sector of 'location', writing the one it held before. A 'fresh'
+ * sector has nothing in use at or after the location and is not read */
+int load_dir_sector( FAT_FILESYSTEM* fs, FAT_DIR_SECTOR* buffer, const FAT_ENTRY_LOCATION* location, BYTE fresh )
+{
+	int		result;
+
+	if( buffer->loaded && buffer->cluster == location->cluster && buffer->sector == location->sector )
+		return FAT_SUCCESS;
+
+	if( flush_dir_sector( fs, buffer ) )
+		return FAT_ERROR;
+
+	if( fresh && location->number == 0 )
+	{
+		ZeroMemory( buffer->data, fs->bpb.bytesPerSector ); // 모두 DIR_ENTRY_NO_MORE
+		result = FAT_SUCCESS;
+	}
+	else if( location->cluster == 0 && ( fs->FATType == FAT12 || fs->FATType == FAT16 ) )
+		result = read_root_sector( fs, location->sector, buffer->data );
+	else
+		result = read_data_sector( fs, location->cluster, location->sector, buffer->data );
+
+	if( result )
+		return FAT_ERROR;
+
+	buffer->cluster	= location->cluster;
+	buffer->sector	= location->sector;
+	buffer->loaded	= 1;
+
+	return FAT_SUCCESS;
+}
+
+/* moves an append position to the next entry, following the chain of a data directory */
+void next_entry_location( FAT_FILESYSTEM* fs, int isRoot, FAT_ENTRY_LOCATION* location )
+{
+	if( ++location->number < ( INT32 )( fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY ) ) )
+		return;
+
+	location->number = 0;
+	if( ++location->sector < fs->bpb.sectorsPerCluster || isRoot )
+		return;
+
+	location->sector = 0;
+	location->cluster = get_fat( fs, location->cluster );
+}
+
+/* Makes the chain of a data directory long enough for 'count' entries after 'end' and the
+ * end marker behind them. Missing clusters are allocated as one run. 'grownFrom' receives
+ * the last cluster of the chain if anything may have been linked after it, 0 otherwise */
+int reserve_dir_clusters( FAT_FILESYSTEM* fs, const FAT_ENTRY_LOCATION* end, UINT32 count, UINT32 extraClusters, DWORD* grownFrom )
+{
+	UINT32	entriesPerCluster = fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY ) * fs->bpb.sectorsPerCluster;
+	UINT32	position = end->sector * ( fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY ) ) + end->number;
+	UINT32	need = ( position + count ) / entriesPerCluster; // end의 cluster 뒤에 필요한 cluster 수
+	DWORD	cluster = end->cluster, next;
+
+	if( prepare_fat( fs ) )
+		return FAT_ERROR;
+
+	for( ; need > 0; need-- )
+	{ // 이미 체인에 있는 cluster는 그대로 사용
+		next = get_fat( fs, cluster );
+		if( next < 2 || is_type_eoc( fs->typeInfo, next ) )
+			break;
+		cluster = next;
+	}
+
+	if( need == 0 )
+		return FAT_SUCCESS;
+
+	if( fs->freeClusterMap.freeCount < need + extraClusters )
+	{
+		NO_MORE_CLUSER();
+		return FAT_ERROR;
+	}
+
+	*grownFrom = cluster;
+	if( alloc_cluster_chain( fs, cluster, need ) == 0 )
+	{
+		NO_MORE_CLUSER();
+		return FAT_ERROR;
+	}
+
+	return FAT_SUCCESS;
+}
+
+/* Puts back the entries a failed create_entries may have written: a reused free entry is
+ * free again and an appended one is zeroed, which restores the end marker */
+void erase_created_entries( FAT_FILESYSTEM* fs, const FAT_NODE* nodes, UINT32 count, UINT32 holeCount )
+{
+	FAT_DIR_SECTOR	buffer;
+	FAT_DIR_ENTRY*	entry;
+	UINT32			i;
+
+	buffer.loaded = 0;
+	for( i = 0; i < count; i++ )
+	{
+		if( load_dir_sector( fs, &buffer, &nodes[i].location, 0 ) )
+			continue; // 읽지 못한 sector는 그대로 둠
+
+		entry = &( ( FAT_DIR_ENTRY* )buffer.data )[nodes[i].location.number];
+		if( i < holeCount )
+			entry->name[0] = DIR_ENTRY_FREE;
+		else
+			ZeroMemory( entry, sizeof( FAT_DIR_ENTRY ) );
+	}
+
+	flush_dir_sector( fs, &buffer );
+}
+
+/* Undoes the cluster allocations of a failed create_entries in one FAT batch: the clusters
+ * of the new directories are freed and the parent chain is cut back after 'grownFrom' */
+int release_created_clusters( FAT_FILESYSTEM* fs, DWORD grownFrom, const DWORD* clusters, UINT32 count )
+{
+	const FAT_TYPE_INFO*	type = fs->typeInfo;
+	FAT_BATCH	batch;
+	DWORD		cluster, length = 0;
+	UINT32		i;
+	int			result = FAT_SUCCESS;
+
+	fat_batch_begin( fs, &batch );
+
+	for( i = 0; i < count && result == FAT_SUCCESS; i++ )
+		result = fat_batch_set( &batch, clusters[i], FREE_CLUSTER );
+
+	if( grownFrom && result == FAT_SUCCESS )
+	{ // parent에 이어 붙인 cluster들
+		cluster = get_fat( fs, grownFrom );
+		while( result == FAT_SUCCESS && cluster >= 2 && cluster < fs->fatEntries && !is_type_eoc( type, cluster ) &&
+			   length++ < fs->fatEntries )
+		{
+			result = fat_batch_set( &batch, cluster, FREE_CLUSTER );
+			cluster = get_fat( fs, cluster );
+		}
+
+		if( result == FAT_SUCCESS )
+			result = fat_batch_set( &batch, grownFrom, type->MS_EOC );
+	}
+
+	if( result )
+	{
+		fat_batch_abort( &batch );
+		return FAT_ERROR;
+	}
+
+	return fat_batch_commit( &batch );
+}
+
+/* Creates 'count' entries in one directory. Every name is checked against one snapshot
+ * of the directory, its name index, before anything is written. Free entries are used
+ * first and the rest is appended at the end marker. Each directory sector is written
+ * once, clusters of the new directories and of the grown parent are allocated as runs */
+int create_entries( const FAT_NODE* parent, const char* const* names, UINT32 count, BYTE attribute, FAT_NODE* retEntries )
+{
+	FAT_FILESYSTEM*		fs = parent->fs;
+	UINT32				entriesPerSector = fs->bpb.bytesPerSector / sizeof( FAT_DIR_ENTRY );
+	int					isRoot = IS_POINT_ROOT_ENTRY( parent->entry ) && ( fs->FATType == FAT12 || fs->FATType == FAT16 );
+	DIR_INDEX*			index;
+	DIR_INDEX			batchNames;
+	FAT_NODE*			nodes = retEntries;
+	FAT_ENTRY_LOCATION*	holes = NULL;
+	FAT_ENTRY_LOCATION	position;
+	FAT_DIR_SLOTS		after;
+	FAT_DIR_SECTOR		buffer;
+	FAT_DIR_ENTRY*		entry;
+	FAT_NODE			node;
+	DWORD*				clusters = NULL;
+	DWORD				grownFrom = 0;
+	char				name[MAX_NAME_LENGTH];
+	UINT32				i, holeCount, appendCount, allocated = 0, placed = 0;
+	int					result = FAT_ERROR;
+
+	if( count == 0 )
+		return FAT_SUCCESS;
+
+	index = get_dir_index( parent );
+	if( index == NULL )
+	{ // index를 만들 수 없으면 하나씩 생성
+		for( i = 0; i < count; i++ )
+		{
+			result = ( attribute & ATTR_DIRECTORY ? fat_mkdir( parent, names[i], &node ) :
+												   fat_create( ( FAT_NODE* )parent, names[i], &node ) );
+			if( result )
+				return FAT_ERROR;
+			if( retEntries )
+				retEntries[i] = node;
+		}
+		return FAT_SUCCESS;
+	}
+
+	if( nodes == NULL )
+		nodes = ( FAT_NODE* )malloc( count * sizeof( FAT_NODE ) );
+	holeCount = ( count < index->holeCount ? count : index->holeCount );
+	holes = ( FAT_ENTRY_LOCATION* )malloc( ( holeCount + 1 ) * sizeof( FAT_ENTRY_LOCATION ) );
+	if( attribute & ATTR_DIRECTORY )
+		clusters = ( DWORD* )malloc( count * sizeof( DWORD ) );
+	ZeroMemory( &batchNames, sizeof( DIR_INDEX ) );
+
+	if( nodes == NULL || holes == NULL || ( ( attribute & ATTR_DIRECTORY ) && clusters == NULL ) )
+		goto cleanup;
+
+	/* 모든 이름을 쓰기 전에 검사: 형식, 디렉토리에 있는 이름, batch 안의 중복 */
+	for( i = 0; i < count; i++ )
+	{
+		ZeroMemory( name, sizeof( name ) );
+		strncpy( name, names[i], MAX_NAME_LENGTH - 1 );
+		if( format_name( fs, name ) || lookup_dir_index( index, ( BYTE* )name ) || lookup_dir_index( &batchNames, ( BYTE* )name ) ||
+			insert_dir_index( &batchNames, ( BYTE* )name, 0, 0, i ) )
+			goto cleanup;
+
+		ZeroMemory( &nodes[i], sizeof( FAT_NODE ) );
+		nodes[i].fs = fs;
+		memcpy( nodes[i].entry.name, name, MAX_ENTRY_NAME_LENGTH );
+		nodes[i].entry.attribute = attribute;
+	}
+
+	/* 넣을 자리: 빈 entry를 sector 순서로, 나머지는 end marker부터 */
+	for( i = 0; i < holeCount; i++ )
+	{
+		holes[i].cluster	= index->holes[index->holeCount - 1 - i].cluster;
+		holes[i].sector		= index->holes[index->holeCount - 1 - i].sector;
+		holes[i].number		= index->holes[index->holeCount - 1 - i].number;
+	}
+	qsort( holes, holeCount, sizeof( FAT_ENTRY_LOCATION ), compare_entry_locations );
+
+	appendCount = count - holeCount;
+	ZeroMemory( &after, sizeof( FAT_DIR_SLOTS ) );
+	after.hasEnd		= index->hasEnd;
+	after.end.cluster	= index->end.cluster;
+	after.end.sector	= index->end.sector;
+	after.end.number	= index->end.number;
+
+	if( appendCount && !after.hasEnd )
+	{
+		if( isRoot )
+			WARNING( "Cannot insert entry into the root entry\n" );
+		else
+			WARNING( "Cannot insert entry into the directory\n" );
+		goto cleanup;
+	}
+
+	if( appendCount && isRoot )
+	{
+		if( after.end.sector * entriesPerSector + after.end.number + appendCount > fs->bpb.rootEntryCount )
+		{
+			WARNING( "Cannot insert entry into the root entry\n" );
+			goto cleanup;
+		}
+	}
+	else if( appendCount && reserve_dir_clusters( fs, &after.end, appendCount, ( clusters ? count : 0 ), &grownFrom ) )
+		goto undo;
+
+	/* 새 디렉토리들의 cluster와 ., .. entry. parent에 보이기 전에 써 둠 */
+	if( clusters )
+	{
+		if( alloc_free_clusters( fs, count, clusters ) )
+		{
+			NO_MORE_CLUSER();
+			goto undo;
+		}
+		allocated = count;
+
+		ZeroMemory( buffer.data, fs->bpb.bytesPerSector );
+		entry = ( FAT_DIR_ENTRY* )buffer.data;
+		memset( entry[0].name, 0x20, MAX_ENTRY_NAME_LENGTH );
+		entry[0].name[0] = '.';
+		entry[0].attribute = ATTR_DIRECTORY;
+		memset( entry[1].name, 0x20, MAX_ENTRY_NAME_LENGTH );
+		entry[1].name[0] = '.';
+		entry[1].name[1] = '.';
+		entry[1].attribute = ATTR_DIRECTORY;
+		SET_FIRST_CLUSTER( entry[1], GET_FIRST_CLUSTER( parent->entry ) );
+
+		for( i = 0; i < count; i++ )
+		{
+			SET_FIRST_CLUSTER( entry[0], clusters[i] );
+			if( write_data_sector( fs, clusters[i], 0, buffer.data ) )
+				goto undo;
+
+			SET_FIRST_CLUSTER( nodes[i].entry, clusters[i] );
+			purge_dentry_dir( &fs->dentryCache, clusters[i] ); // 재사용된 cluster에 남은 이름은 버림
+		}
+	}
+
+	/* parent의 entry들, sector마다 한번씩 씀 */
+	result = FAT_ERROR;
+	buffer.loaded = 0;
+	position = after.end;
+	for( i = 0; i < count; i++ )
+	{
+		if( i < holeCount )
+			nodes[i].location = holes[i];
+		else
+		{
+			nodes[i].location = position;
+			next_entry_location( fs, isRoot, &position );
+		}
+		placed = i + 1;
+
+		if( load_dir_sector( fs, &buffer, &nodes[i].location, ( BYTE )( i >= holeCount ) ) )
+			goto failed;
+		( ( FAT_DIR_ENTRY* )buffer.data )[nodes[i].location.number] = nodes[i].entry;
+	}
+
+	if( appendCount )
+	{ // End of entries, root 영역의 끝이면 marker 없이 끝남
+		after.hasEnd = !( isRoot && position.sector * entriesPerSector + position.number >= fs->bpb.rootEntryCount );
+		after.end = position;
+		if( after.hasEnd )
+		{
+			if( load_dir_sector( fs, &buffer, &position, 1 ) )
+				goto failed;
+			ZeroMemory( &( ( FAT_DIR_ENTRY* )buffer.data )[position.number], sizeof( FAT_DIR_ENTRY ) );
+		}
+	}
+
+	if( flush_dir_sector( fs, &buffer ) )
+		goto failed;
+
+	for( i = 0; i < count; i++ )
+		index_new_entry( parent, &nodes[i], &after ); // parent의 name index에 추가
+
+	result = FAT_SUCCESS;
+	goto cleanup;
+
+failed:
+	buffer.loaded = 0; // 쓰지 않은 sector는 버림
+	erase_created_entries( fs, nodes, placed, holeCount ); // 일부만 써졌을 수 있음
+	invalidate_dir_index( &fs->dirIndex, get_dir_cluster( parent ) );
+	purge_dentry_dir( &fs->dentryCache, get_dir_cluster( parent ) );
+undo:
+	release_created_clusters( fs, grownFrom, clusters, allocated ); // 할당한 cluster는 모두 반환
+	if( grownFrom )
+		invalidate_extent_map( &fs->extentCache, get_dir_cluster( parent ) );
+cleanup:
+	free( batchNames.slots );
+	free( holes );
+	free( clusters );
+	if( nodes != retEntries )
+		free( nodes );
+
+	return result;
+}
+
+/* creates the directories 'names' under parent, 'retEntries' receives their nodes unless it is NULL */
+int fat_mkdir_batch( const FAT_NODE* parent, const char* const* names, UINT32 count, FAT_NODE* retEntries )
+{
+	return create_entries( parent, names, count, ATTR_DIRECTORY, retEntries );
+}
+
+/* creates the empty files 'names' under parent, 'retEntries' receives their nodes unless it is NULL */
+int fat_create_batch( const FAT_NODE* parent, const char* const* names, UINT32 count, FAT_NODE* retEntries )
+{
+	return create_entries( parent, names, count, 0, retEntries );
+}
+
+/******************************************************************************/
+/* Read file                                                                  */
+/******************************************************************************/
+/* Moves a chain cursor to the 'index'th cluster of the file. The next cluster costs one
+ * FAT lookup, any other one is found through the extent map. If the chain is shorter,
+ * the cursor is kept and its last cluster and length are returned in 'last', 'chainLength' */
+int seek_file_cluster( FAT_NODE* file, FAT_CURSOR* cursor, DWORD index, DWORD* last, DWORD* chainLength )
+{
+	DWORD	cluster, count;
+
+	if( cursor->cluster && index == cursor->seq + 1 )
+	{
+		cluster = get_fat( file->fs, cursor->cluster );
+		if( !is_type_eoc( file->fs->typeInfo, cluster ) && cluster >= 2 && cluster < file->fs->fatEntries )
+		{
+			cursor->cluster = cluster;
+			cursor->seq = index;
+			return FAT_SUCCESS;
+		}
+	}
+
+	if( map_file_cluster( file->fs, GET_FIRST_CLUSTER( file->entry ), index, &cluster, &count ) )
+	{
+		*last = cluster;
+		*chainLength = count;
+		return FAT_ERROR;
+	}
+
+	cursor->cluster = cluster;
+	cursor->seq = index;
+
+	return FAT_SUCCESS;
+}
+
+/* Follows the reads of a stream. A read which starts the file or continues where the last
+ * one ended doubles the window, any other one closes it. The clusters after the read are
+ * read ahead once less than half a window of them is left */
+void read_file_ahead( FAT_NODE* file, FAT_READAHEAD* ra, DWORD offset, DWORD readEnd )
+{
+	FAT_FILESYSTEM*	fs = file->fs;
+	DWORD			firstCluster = GET_FIRST_CLUSTER( file->entry );
+	DWORD			limit = get_readahead_limit( fs );
+	DWORD			clusterSize = fs->bpb.bytesPerSector * fs->bpb.sectorsPerCluster;
+	DWORD			lastIndex, from, to, cluster, count;
+
+	if( offset >= readEnd || limit == 0 || firstCluster < 2 )
+		return;
+
+	if( offset != 0 && ra->firstCluster == firstCluster && offset == ra->nextOffset && ra->window )
+		ra->window = MIN( ra->window * 2, limit );
+	else if( offset == 0 || ( ra->firstCluster == firstCluster && offset == ra->nextOffset ) )
+	{ // 새 stream의 시작
+		ra->window = MIN( READAHEAD_MIN_CLUSTERS, limit );
+		ra->ahead = 0;
+	}
+	else
+	{ // random access
+		ra->window = 0;
+		ra->ahead = 0;
+	}
+	ra->firstCluster = firstCluster;
+	ra->nextOffset = readEnd;
+
+	lastIndex = ( readEnd - 1 ) / clusterSize;
+	if( ra->window == 0 || ra->ahead > lastIndex + ra->window / 2 )
+		return;
+
+	from = MAX( ra->ahead, lastIndex + 1 );
+	to = MIN( lastIndex + ra->window, ( file->entry.fileSize - 1 ) / clusterSize ); // 파일의 마지막 cluster까지
+	if( from > to || map_file_cluster( fs, firstCluster, from, &cluster, &count ) )
+		return;
+
+	prefetch_clusters( fs, cluster, to - from + 1 ); // 실패해도 읽기에서 다시 시도됨
+	ra->ahead = to + 1;
+}
+
+/* Reads file data from 'offset' starting the chain walk at 'cursor', which is left at the
+ * last cluster read. 'ra' follows the stream for read ahead, NULL if there is none */
+int read_file_data( FAT_NODE* file, FAT_CURSOR* cursor, FAT_READAHEAD* ra, unsigned long offset, unsigned long length, char* buffer )
+{
+	BYTE	sector[MAX_SECTOR_SIZE];
+	DWORD	currentOffset, currentCluster;
 	DWORD	clusterNumber, sectorNumber, sectorOffset;
-	DWORD	readEnd;
-	DWORD	clusterSize, clusterOffset = 0;
+	DWORD	readEnd, chainEnd, chainLength;
+	DWORD	clusterSize;
+	DWORD	bytesPerSector = file->fs->bpb.bytesPerSector;
 
-	currentCluster = GET_FIRST_CLUSTER( file->entry ); // 읽을 file->entry의 first cluster
+	if( cursor->cluster == 0 )
+	{
+		cursor->cluster = GET_FIRST_CLUSTER( file->entry ); // 읽을 file->entry의 first cluster
+		cursor->seq = 0;
+	}
 	readEnd = MIN( offset + length, file->entry.fileSize ); // 어디까지 읽을건지
+	if( ra )
+		read_file_ahead( file, ra, offset, readEnd );
 	
 	currentOffset = offset; //읽기 시작할 offset
 
-	clusterSize = ( file->fs->bpb.bytesPerSector * file->fs->bpb.sectorsPerCluster ); //클러스터 사이즈
-	clusterOffset = clusterSize; // cluster 끝까지 읽었는지 확인 위한 offset
-
-	while( offset > clusterOffset )
-	{ // offset이 clusteroffset보다 클 수 없음(?)
-	// 만약 크면 다음 클러스터 가져옴
-		currentCluster = get_fat( file->fs, currentCluster );
-		clusterOffset += clusterSize;
-		clusterSeq++;
-	}
+	clusterSize = ( bytesPerSector * file->fs->bpb.sectorsPerCluster ); //클러스터 사이즈
 
 	while( currentOffset < readEnd )
 	{ // currentOffset으로 readEnd 까지 읽어냄
 		DWORD	copyLength;
 
-		clusterNumber	= currentOffset / ( file->fs->bpb.bytesPerSector * file->fs->bpb.sectorsPerCluster );
+		clusterNumber	= currentOffset / clusterSize;
 		// offset / cluster한개 사이즈로 넘버링
-		if( clusterSeq != clusterNumber ) 
-		{
-			// 처음엔 둘다 0, 읽으면서 currentOffset이 증가하고 결국 clusterNumber++됨 따라서 다음 cluster읽어야 할 차례
-			clusterSeq++; // 클러스터 SEQ 증가 시키고
-			currentCluster = get_fat( file->fs, currentCluster ); //다음 클러스터 가져옴
+		if( cursor->seq != clusterNumber )
+		{ // currentOffset이 가리키는 cluster로 cursor 이동
+			if( seek_file_cluster( file, cursor, clusterNumber, &chainEnd, &chainLength ) )
+				break;
 		}
-		sectorNumber	= ( currentOffset / ( file->fs->bpb.bytesPerSector ) ) % file->fs->bpb.sectorsPerCluster;
+		currentCluster = cursor->cluster;
+
+		sectorNumber	= ( currentOffset / bytesPerSector ) % file->fs->bpb.sectorsPerCluster;
 		// 클러스터 내 sector num
-		sectorOffset	= currentOffset % file->fs->bpb.bytesPerSector;
+		sectorOffset	= currentOffset % bytesPerSector;
 		// sector 내 byte offset
-		if( read_data_sector( file->fs, currentCluster, sectorNumber, sector ) ) //한 섹터 내용 data에 복사
-			break; // disk 입출력 오류난 경우(-1리턴함)
 
-		copyLength = MIN( file->fs->bpb.bytesPerSector - sectorOffset, readEnd - currentOffset );
-		//한 섹터씩 읽으므로 sectoroffset은 항상0이므로 결국 한 섹터 크기임 
-		//copyLength = min(한섹터크기, readend까지 남은 byte) 
-		//즉 평소엔 한 섹터 크기, 마지막 섹터에서만 남은 offset나타냄
+		if( sectorOffset == 0 && readEnd - currentOffset >= bytesPerSector )
+		{
+			/* whole sectors go straight to the caller's buffer, one call per run of physically
+			 * contiguous clusters. Only a partial head or tail sector is bounced */
+			SECTOR	sectors;
+
+			sectors = get_file_run( file, cursor, sectorNumber, ( readEnd - currentOffset ) / bytesPerSector );
+			if( read_data_sectors( file->fs, currentCluster, sectorNumber, sectors, ( BYTE* )buffer ) )
+				break; // disk 입출력 오류난 경우(-1리턴함)
+
+			copyLength = sectors * bytesPerSector;
+		}
+		else
+		{
+			if( read_data_sector( file->fs, currentCluster, sectorNumber, sector ) ) //한 섹터 내용 data에 복사
+				break;
+
+			copyLength = MIN( bytesPerSector - sectorOffset, readEnd - currentOffset );
+			// 앞뒤가 잘린 섹터만 sector버퍼를 거쳐 복사
 
-		memcpy( buffer,
-				&sector[sectorOffset],
-				copyLength );
+			memcpy( buffer,
+					&sector[sectorOffset],
+					copyLength );
+		}
 
 		buffer += copyLength; // 다음섹터로 or 끝으로
 		currentOffset += copyLength;// 다음섹터로 or 끝으로
@@ -1483,105 +3102,269 @@ int fat_read( FAT_NODE* file, unsigned long offset, unsigned long length, char*
 	return currentOffset - offset;
 }
 
+int fat_read( FAT_NODE* file, unsigned long offset, unsigned long length, char* buffer )
+{
+	FAT_CURSOR	cursor = { 0, 0 };
+
+	return read_file_data( file, &cursor, &file->fs->readahead, offset, length, buffer );
+}
+
 /******************************************************************************/
 /* Write file                                                                 */
 /******************************************************************************/
-int fat_write( FAT_NODE* file, unsigned long offset, unsigned long length, const char* buffer )
+/* Writes file data from 'offset' starting the chain walk at 'cursor', allocating clusters
+ * as needed. Only the fileSize in memory is updated, the caller stores the entry */
+int write_file_data( FAT_NODE* file, FAT_CURSOR* cursor, unsigned long offset, unsigned long length, const char* buffer )
 {
 	BYTE	sector[MAX_SECTOR_SIZE];
-	DWORD	currentOffset, currentCluster, clusterSeq = 0;
+	DWORD	currentOffset, currentCluster;
 	DWORD	clusterNumber, sectorNumber, sectorOffset;
-	DWORD	readEnd;
+	DWORD	readEnd, lastSeq;
 	DWORD	clusterSize;
+	DWORD	bytesPerSector = file->fs->bpb.bytesPerSector;
 
-	currentCluster = GET_FIRST_CLUSTER( file->entry ); 
+	if( cursor->cluster == 0 )
+	{
+		cursor->cluster = GET_FIRST_CLUSTER( file->entry ); 
+		cursor->seq = 0;
+	}
 	readEnd = offset + length; // 쓰기 동작은 파일 크기 고려 X, cluster 추가해 가면서 쓰기 진행
 	//offset<0> +length<입력받은 size>를 쓰기동작의 한계점으로 지정
 
 	currentOffset = offset;
 
-	clusterSize = ( file->fs->bpb.bytesPerSector * file->fs->bpb.sectorsPerCluster ); // 클러스터 크기 = 섹터 크기*클러스터당 섹터개수
-	while( offset > clusterSize )
-	{
-		currentCluster = get_fat( file->fs, currentCluster ); //Read a FAT entry from FAT Table
-		clusterSize += clusterSize;
-		clusterSeq++;
-	}
+	clusterSize = ( bytesPerSector * file->fs->bpb.sectorsPerCluster ); // 클러스터 크기 = 섹터 크기*클러스터당 섹터개수
+	lastSeq = ( readEnd - 1 ) / clusterSize; // 쓰기가 끝나는 cluster 번호
 
 	while( currentOffset < readEnd )
 	{
 		DWORD	copyLength;
 
-		clusterNumber	= currentOffset / ( file->fs->bpb.bytesPerSector * file->fs->bpb.sectorsPerCluster );
+		clusterNumber	= currentOffset / clusterSize;
 		//현재 offset을 클러스터 크기로 나눠 번호 매김
-		if( currentCluster == 0 ) // cluster를 할당해주지 않은 비어있는 파일일 때
+		if( cursor->cluster == 0 ) // cluster를 할당해주지 않은 비어있는 파일일 때
 		{
-			currentCluster = alloc_free_cluster( file->fs ); // cluster 할당
-			if( currentCluster == 0 )
+			cursor->cluster = alloc_cluster_chain( file->fs, 0, lastSeq + 1 ); // 쓰기 크기만큼 연속 할당
+			if( cursor->cluster == 0 )
 			{
 				NO_MORE_CLUSER();
 				return FAT_ERROR;
 			}
 
-			SET_FIRST_CLUSTER( file->entry, currentCluster ); //currentCluster를 file->entry의 first_cluster로 지정
-			set_fat( file->fs, currentCluster, get_MS_EOC( file->fs->FATType ) ); //생성 파일의 fat_entry FATable에 작성
+			cursor->seq = 0;
+			SET_FIRST_CLUSTER( file->entry, cursor->cluster ); //할당한 cluster를 file->entry의 first_cluster로 지정
 		}
 
-		if( clusterSeq != clusterNumber ) // 다음 cluster에 써야 한다면
+		if( cursor->seq != clusterNumber ) // 다음 cluster에 써야 한다면
 		{
-			DWORD nextCluster;
-			clusterSeq++;
+			DWORD	chainEnd, chainLength;
 
-			nextCluster = get_fat( file->fs, currentCluster );
-			if( is_EOC( file->fs->FATType, nextCluster ) ) // nextCluster가 eoc이면
+			if( seek_file_cluster( file, cursor, clusterNumber, &chainEnd, &chainLength ) )
 			{
-				nextCluster = span_cluster_chain( file->fs, currentCluster ); // 클러스터 할당
-
-				if( nextCluster == 0 )
+				// 체인이 짧으면 끝(chainEnd)에 남은 cluster를 한번에 할당
+				if( alloc_cluster_chain( file->fs, chainEnd, lastSeq + 1 - chainLength ) == 0 ||
+					seek_file_cluster( file, cursor, clusterNumber, &chainEnd, &chainLength ) )
 				{
 					NO_MORE_CLUSER();
 					break;
 				}
 			}
-			currentCluster = nextCluster;
 		}
-		
-		sectorNumber	= ( currentOffset / ( file->fs->bpb.bytesPerSector ) ) % file->fs->bpb.sectorsPerCluster;
+		currentCluster = cursor->cluster;
+
+
+		sectorNumber	= ( currentOffset / bytesPerSector ) % file->fs->bpb.sectorsPerCluster;
 		// cluster 에서의 sector offset
 
-		sectorOffset	= currentOffset % file->fs->bpb.bytesPerSector;
+		sectorOffset	= currentOffset % bytesPerSector;
 		// sector 에서의 byte offset 
-		// sectorOffset는 마지막을 제외하고는 항상 0임 왜냐하면 currentOffset이 copyLength(한 섹터 크기)만큼 증가하기 때문
-		// 마지막엔 남은 offset 수 이므로 0이 아님
 
-		copyLength = MIN( file->fs->bpb.bytesPerSector - sectorOffset, readEnd - currentOffset );
-		// 보통 한 섹터씩 작성하므로 작성할 크기가 한 섹터 넘는 경우 file->fs->bpb.bytesPerSector - sectorOffset는 bytesPerSector와 동일
-		// 남은 작성 크기가 한 섹터보다 작은 경우 >> 작성해야할 length - 작성한 offset >> 남은 작성 수만 작성하면 됨. >> 섹터 더이상 안 읽어와도 됨 
+		if( sectorOffset == 0 && readEnd - currentOffset >= bytesPerSector )
+		{
+			/* whole sectors are written from the caller's buffer, one call per contiguous run
+			 * of clusters which are already linked to the chain */
+			SECTOR	sectors;
+
+			sectors = get_file_run( file, cursor, sectorNumber, ( readEnd - currentOffset ) / bytesPerSector );
+			if( write_data_sectors( file->fs, currentCluster, sectorNumber, sectors, ( const BYTE* )buffer ) )
+				break;
 
-		if( copyLength != file->fs->bpb.bytesPerSector )
+			copyLength = sectors * bytesPerSector;
+		}
+		else
 		{
-			//마지막에 copyLength와 한 섹터 크기가 달라짐 
+			copyLength = MIN( bytesPerSector - sectorOffset, readEnd - currentOffset );
+			// 한 섹터를 다 채우지 못하는 경우만 read-modify-write
+
 			if( read_data_sector( file->fs, currentCluster, sectorNumber, sector ) )
 				break;
-		}
 
-		memcpy( &sector[sectorOffset],
-				buffer,
-				copyLength ); // 한 섹터만큼 메모리 세팅
+			memcpy( &sector[sectorOffset],
+					buffer,
+					copyLength );
 
-		if( write_data_sector( file->fs, currentCluster, sectorNumber, sector ) )
-			break;
+			if( write_data_sector( file->fs, currentCluster, sectorNumber, sector ) )
+				break;
+		}
 
-		buffer += copyLength; // 한 섹터만큼 버퍼 증가
-		currentOffset += copyLength; // 한 섹터만큼 offset증가
+		buffer += copyLength; // 쓴 만큼 버퍼 증가
+		currentOffset += copyLength; // 쓴 만큼 offset증가
 	}
 
 	file->entry.fileSize = MAX( currentOffset, file->entry.fileSize ); // file size set
-	set_entry( file->fs, &file->location, &file->entry ); // 실제 DATA영역에 해당 ENTRY 저장
 
 	return currentOffset - offset;
 }
 
+int fat_write( FAT_NODE* file, unsigned long offset, unsigned long length, const char* buffer )
+{
+	FAT_CURSOR	cursor = { 0, 0 };
+	int			result;
+
+	result = write_file_data( file, &cursor, offset, length, buffer );
+	if( result < 0 )
+		return result;
+
+	set_entry( file->fs, &file->location, &file->entry ); // 실제 DATA영역에 해당 ENTRY 저장
+
+	return result;
+}
+
+/******************************************************************************/
+/* Open file handles                                                          */
+/******************************************************************************/
+/* A handle keeps the position and the chain cursor between calls. Small writes which
+ * continue or overwrite each other are collected in the handle and reach the disk as
+ * whole sectors. They and the entry with the new size and first cluster are stored only
+ * by fat_file_flush and fat_close, a full buffer or an access elsewhere in the file */
+int fat_open( const FAT_NODE* node, FAT_FILE* file )
+{
+	if( node->entry.attribute & ATTR_DIRECTORY ) // 디렉토리는 열 수 없음
+		return FAT_ERROR;
+
+	ZeroMemory( file, sizeof( FAT_FILE ) );
+	file->node = *node;
+
+	return FAT_SUCCESS;
+}
+
+/* Writes the collected bytes of the handle. With 'keepTail' a partial last sector stays
+ * collected, so appends are not written a piece of a sector at a time */
+int flush_file_buffer( FAT_FILE* file, BYTE keepTail )
+{
+	DWORD	bytesPerSector = file->node.fs->bpb.bytesPerSector;
+	DWORD	length = file->bufferLength;
+	DWORD	end = file->bufferStart + length;
+	int		result;
+
+	if( keepTail && end % bytesPerSector )
+	{
+		end -= end % bytesPerSector;
+		length = ( end > file->bufferStart ? end - file->bufferStart : 0 );
+	}
+
+	if( length == 0 )
+		return FAT_SUCCESS;
+
+	result = write_file_data( &file->node, &file->cursor, file->bufferStart, length, ( const char* )file->buffer );
+	if( result >= 0 )
+		file->dirty = 1; // first cluster가 할당됐을 수도 있음
+	if( result != ( int )length )
+		return FAT_ERROR; // 모아둔 내용은 그대로 두어 다시 쓸 수 있게 함
+
+	memmove( file->buffer, &file->buffer[length], file->bufferLength - length );
+	file->bufferStart	+= length;
+	file->bufferLength	-= length;
+
+	return FAT_SUCCESS;
+}
+
+/* true if a write of 'length' bytes at the position can be added to the collected ones */
+int fits_file_buffer( const FAT_FILE* file, unsigned long length )
+{
+	DWORD	capacity = file->node.fs->bpb.bytesPerSector * FAT_WRITE_BUFFER_SECTORS;
+
+	if( file->bufferLength == 0 )
+		return 1;
+
+	return file->position >= file->bufferStart && file->position <= file->bufferStart + file->bufferLength &&
+		file->position - file->bufferStart + length <= capacity;
+}
+
+int fat_file_read( FAT_FILE* file, unsigned long length, char* buffer )
+{
+	int		result;
+
+	if( flush_file_buffer( file, 0 ) ) // 모아둔 쓰기가 읽히도록
+		return FAT_ERROR;
+
+	result = read_file_data( &file->node, &file->cursor, &file->readahead, file->position, length, buffer );
+	if( result > 0 )
+		file->position += result;
+
+	return result;
+}
+
+int fat_file_write( FAT_FILE* file, unsigned long length, const char* buffer )
+{
+	int		result;
+
+	if( length < file->node.fs->bpb.bytesPerSector * FAT_WRITE_BUFFER_SECTORS )
+	{
+		if( !fits_file_buffer( file, length ) && flush_file_buffer( file, 1 ) ) // 온전한 섹터만 쓰고 마지막 섹터는 남김
+			return FAT_ERROR;
+		if( !fits_file_buffer( file, length ) && flush_file_buffer( file, 0 ) ) // 이어지지 않는 위치
+			return FAT_ERROR;
+
+		if( file->bufferLength == 0 )
+			file->bufferStart = file->position;
+
+		memcpy( &file->buffer[file->position - file->bufferStart], buffer, length );
+		file->bufferLength = MAX( file->bufferLength, file->position + length - file->bufferStart );
+		file->position += length;
+
+		return length;
+	}
+
+	if( flush_file_buffer( file, 0 ) ) // 큰 쓰기는 모으지 않고 바로 씀
+		return FAT_ERROR;
+
+	result = write_file_data( &file->node, &file->cursor, file->position, length, buffer );
+	if( result > 0 )
+		file->position += result;
+	if( result >= 0 )
+		file->dirty = 1; // first cluster가 할당됐을 수도 있음
+
+	return result;
+}
+
+int fat_file_seek( FAT_FILE* file, unsigned long position )
+{
+	file->position = position; // cursor는 다음 입출력에서 extent map으로 이동
+
+	return FAT_SUCCESS;
+}
+
+int fat_file_flush( FAT_FILE* file )
+{
+	if( flush_file_buffer( file, 0 ) )
+		return FAT_ERROR;
+
+	if( !file->dirty )
+		return FAT_SUCCESS;
+
+	if( set_entry( file->node.fs, &file->node.location, &file->node.entry ) )
+		return FAT_ERROR;
+	file->dirty = 0;
+
+	return FAT_SUCCESS;
+}
+
+int fat_close( FAT_FILE* file )
+{
+	return fat_file_flush( file );
+}
+
 /******************************************************************************/
 /* Remove file                                                                */
 /******************************************************************************/
@@ -1603,12 +3386,19 @@ int fat_remove( FAT_NODE* file )
 //bpb 읽어서 특성 출력
 int fat_df( FAT_FILESYSTEM* fs, UINT32* totalSectors, UINT32* usedSectors )
 {
+	UINT32	freeCount;
+
 	if( fs->bpb.totalSectors != 0 )
 		*totalSectors = fs->bpb.totalSectors;
 	else
 		*totalSectors = fs->bpb.totalSectors32;
 
-	*usedSectors = *totalSectors - ( fs->freeClusterList.count * fs->bpb.sectorsPerCluster );
+	if( fs->fatTable )
+		freeCount = fs->freeClusterMap.freeCount;
+	else
+		freeCount = fs->info32.freeCount; // FAT이 load되기 전에는 FSInfo 값
+
+	*usedSectors = *totalSectors - ( freeCount * fs->bpb.sectorsPerCluster );
 
 	return FAT_SUCCESS;
 }
@@ -14,7 +14,11 @@
 
 #include "common.h"
 #include "disk.h"
-#include "clusterlist.h"
+#include "clustermap.h"
+#include "bcache.h"
+#include "extentmap.h"
+#include "fattype.h"
+#include "dirindex.h"
 
 #define FAT12					0
 #define FAT16					1
@@ -23,6 +27,18 @@
 #define MAX_SECTOR_SIZE			512
 #define MAX_NAME_LENGTH			256
 #define MAX_ENTRY_NAME_LENGTH	11
+#define FAT_CACHE_SECTORS		BCACHE_DEFAULT_BUFFERS	/* default size of the sector buffer cache */
+#define FAT_BATCH_INITIAL		64		/* updates a batch makes room for at first */
+#define FAT_DIR_BATCH			16		/* entries of one 512 byte sector, what fat_readdir_next returns at most at once */
+#define DIR_READ_SECTORS		8		/* sectors per read_sectors call while reading a directory */
+#define DENTRY_CACHE_SETS		64		/* dentry cache lines, selected by a hash of the parent cluster and name */
+#define DENTRY_CACHE_WAYS		4
+#define FAT_WRITE_BUFFER_SECTORS	8	/* small writes a handle collects before they go to the disk */
+#define READAHEAD_MIN_CLUSTERS	2		/* window of a stream which just started, doubled on every sequential read */
+
+#define DENTRY_EMPTY			0
+#define DENTRY_POSITIVE			1
+#define DENTRY_NEGATIVE			2		/* the name is known not to be in the directory */
 
 #define ATTR_READ_ONLY			0x01
 #define ATTR_HIDDEN				0x02
@@ -52,6 +68,11 @@
 #define MS_EOC16				0xFFFF
 #define MS_EOC32				0x0FFFFFFF
 
+#define FSINFO_LEAD_SIGNATURE	0x41615252
+#define FSINFO_STRUCT_SIGNATURE	0x61417272
+#define FSINFO_TRAIL_SIGNATURE	0xAA550000
+#define FSINFO_UNKNOWN			0xFFFFFFFF	/* freeCount, nextFree are not known */
+
 #define SET_FIRST_CLUSTER( a, b )	{ ( a ).firstClusterHI = ( b ) >> 16; ( a ).firstClusterLO = ( WORD )( ( b ) & 0xFFFF ); }
 #define GET_FIRST_CLUSTER( a )		( ( ( ( DWORD )( a ).firstClusterHI ) << 16 ) | ( a ).firstClusterLO )
 //#define IS_POINT_ROOT_ENTRY( a )	( ( a ).attribute & ATTR_VOLUME_ID )
@@ -152,14 +173,61 @@ typedef struct
 #pragma pack()
 #endif
 
+typedef struct
+{
+	UINT32	cluster; //관리 클러스터 번호
+	UINT32	sector; // 섹터 위치
+	INT32	number; //섹터 내 몇번위치
+} FAT_ENTRY_LOCATION;
+
+/* Sequential read detection of one stream. While reads continue where the last one
+ * ended, the clusters after them are read ahead into the buffer cache */
+typedef struct
+{
+	DWORD	firstCluster;	/* chain of the stream */
+	DWORD	nextOffset;		/* where a sequential read continues */
+	DWORD	ahead;			/* index of the first cluster not read ahead yet */
+	DWORD	window;			/* clusters to read ahead, 0 while the access is random */
+} FAT_READAHEAD;
+
+/* result of looking up 'name' in the directory whose first cluster is 'parentCluster' */
+typedef struct
+{
+	DWORD				parentCluster;
+	BYTE				name[MAX_ENTRY_NAME_LENGTH];
+	BYTE				state;			/* DENTRY_EMPTY, DENTRY_POSITIVE or DENTRY_NEGATIVE */
+	FAT_DIR_ENTRY		entry;			/* valid if positive */
+	FAT_ENTRY_LOCATION	location;
+	UINT32				lastUsed;
+} FAT_DENTRY;
+
+typedef struct
+{
+	FAT_DENTRY	sets[DENTRY_CACHE_SETS][DENTRY_CACHE_WAYS];
+	UINT32		clock;
+} FAT_DENTRY_CACHE;
+
 typedef struct
 {
 	BYTE			FATType;
+	const FAT_TYPE_INFO*	typeInfo;	/* entry constants of FATType, bound at mount */
 	DWORD			FATSize;
 	DWORD			EOCMark;
 	FAT_BPB			bpb;
-	CLUSTER_LIST	freeClusterList;
-	DISK_OPERATIONS*	disk;
+	CLUSTER_BITMAP	freeClusterMap;	/* a set bit for every free cluster */
+	DISK_OPERATIONS*	disk;			/* points to cache.disk while mounted */
+	BCACHE			cache;
+	UINT32			cacheSize;		/* sectors in the buffer cache, 0 means FAT_CACHE_SECTORS */
+
+	DWORD*			fatTable;		/* decoded entries of the first FAT */
+	UINT32			fatEntries;		/* number of entries in fatTable */
+	BYTE*			fatDirty;		/* one bit per FAT sector which has to be written back */
+	SECTOR			fsInfoSector;	/* FSInfo sector of a FAT32 volume, 0 if there is no valid one */
+	EXTENT_CACHE	extentCache;	/* extent maps of recently accessed chains */
+	DIR_INDEX_CACHE	dirIndex;		/* name indexes of recently searched directories */
+	FAT_DENTRY_CACHE	dentryCache;	/* recent lookups, including names which were not found */
+	FAT_DIR_ENTRY	rootEntry;		/* entry of the root node, where absolute paths start */
+	FAT_READAHEAD	readahead;		/* stream of fat_read, which has no handle */
 
 	union
 	{
@@ -177,13 +245,6 @@ typedef struct
 	WORD	year;
 } FAT_FILETIME;
 
-typedef struct
-{
-	UINT32	cluster; //관리 클러스터 번호
-	UINT32	sector; // 섹터 위치
-	INT32	number; //섹터 내 몇번위치
-} FAT_ENTRY_LOCATION;
-
 typedef struct
 {
 	FAT_FILESYSTEM*		fs;
@@ -191,19 +252,123 @@ typedef struct
 	FAT_ENTRY_LOCATION	location;
 } FAT_NODE;
 
-typedef int ( *FAT_NODE_ADD )( void*, FAT_NODE* );
+/* position in a cluster chain, 'cluster' is the 'seq'th cluster. 0 means not positioned yet */
+typedef struct
+{
+	DWORD	seq;
+	DWORD	cluster;
+} FAT_CURSOR;
+
+typedef struct
+{
+	FAT_NODE	node;			/* entry as updated through the handle */
+	DWORD		position;
+	FAT_CURSOR	cursor;
+	FAT_READAHEAD	readahead;
+	BYTE		dirty;			/* node.entry has to be stored */
+
+	DWORD		bufferStart;	/* file offset of the collected writes */
+	DWORD		bufferLength;	/* 0 if nothing is collected */
+	BYTE		buffer[MAX_SECTOR_SIZE * FAT_WRITE_BUFFER_SECTORS];
+} FAT_FILE;
+
+typedef struct
+{
+	DWORD	cluster;
+	DWORD	value;
+	UINT32	order;			/* keeps the last update of a cluster when they are sorted */
+} FAT_UPDATE;
+
+/* FAT entry updates of one operation, applied sector by sector on commit */
+typedef struct
+{
+	FAT_FILESYSTEM*	fs;
+	FAT_UPDATE*		updates;
+	UINT32			count;
+	UINT32			capacity;
+} FAT_BATCH;
 
-void fat_umount( FAT_FILESYSTEM* fs );
+/* what one pass over a directory found for a create */
+typedef struct
+{
+	BYTE				found;		/* the name is in the directory already, at 'match' */
+	BYTE				hasFree;	/* 'freeSlot' is the first DIR_ENTRY_FREE entry */
+	BYTE				hasEnd;		/* 'end' is the DIR_ENTRY_NO_MORE entry */
+	FAT_ENTRY_LOCATION	match;
+	FAT_ENTRY_LOCATION	freeSlot;
+	FAT_ENTRY_LOCATION	end;
+} FAT_DIR_SLOTS;
+
+/* an entry returned by fat_readdir_next */
+typedef struct
+{
+	FAT_DIR_ENTRY		entry;
+	FAT_ENTRY_LOCATION	location;
+} FAT_DIRENT;
+
+/* Cursor of fat_opendir. Directory sectors are read DIR_READ_SECTORS at a time and
+ * their entries returned a sector at a time, so memory does not grow with the directory */
+typedef struct
+{
+	FAT_FILESYSTEM*		fs;
+	BYTE				isRoot;			/* FAT12/16 root region instead of a cluster chain */
+	BYTE				ended;			/* no sector after the current one */
+	DWORD				cluster;		/* cluster of the next sectors to read, 0 for the root region */
+	SECTOR				sector;			/* next sector to read in the cluster or root region */
+	SECTOR				count;			/* sectors in 'sectors' */
+	SECTOR				index;			/* the current one of them */
+	UINT32				pending;		/* entries of the current sector not returned yet, bit i for entry i */
+	FAT_ENTRY_LOCATION	location;		/* of the current sector, number is unused */
+	DWORD				clusterIndex;	/* of 'cluster' in the chain */
+	DWORD				ahead;			/* first cluster, or root sector, not read ahead yet */
+	DWORD				window;			/* clusters to read ahead */
+	BYTE				sectors[MAX_SECTOR_SIZE * DIR_READ_SECTORS];
+} FAT_DIR;
+
+/* a directory sector a bulk create fills in memory before writing it once */
+typedef struct
+{
+	BYTE		loaded;
+	UINT32		cluster;
+	UINT32		sector;
+	BYTE		data[MAX_SECTOR_SIZE];
+} FAT_DIR_SECTOR;
+
+int fat_format( DISK_OPERATIONS* disk, BYTE FATType );
+int fat_umount( FAT_FILESYSTEM* fs );
+int fat_sync( FAT_FILESYSTEM* fs );
 int fat_read_superblock( FAT_FILESYSTEM* fs, FAT_NODE* root );
-int fat_read_dir( FAT_NODE* dir, FAT_NODE_ADD adder, void* list );
+int fat_opendir( const FAT_NODE* dir, FAT_DIR* cursor );
+int fat_readdir_next( FAT_DIR* cursor, FAT_DIRENT* entries, UINT32 max );
+void fat_closedir( FAT_DIR* cursor );
 int fat_mkdir( const FAT_NODE* parent, const char* entryName, FAT_NODE* retEntry );
 int fat_rmdir( FAT_NODE* node );
 int fat_lookup( FAT_NODE* parent, const char* entryName, FAT_NODE* retEntry );
+int fat_lookup_path( const FAT_NODE* start, const char* path, FAT_NODE* retEntry );
 int fat_create( FAT_NODE* parent, const char* entryName, FAT_NODE* retEntry );
+int fat_mkdir_batch( const FAT_NODE* parent, const char* const* names, UINT32 count, FAT_NODE* retEntries );
+int fat_create_batch( const FAT_NODE* parent, const char* const* names, UINT32 count, FAT_NODE* retEntries );
 int fat_read( FAT_NODE* file, unsigned long offset, unsigned long length, char* buffer );
 int fat_write( FAT_NODE* file, unsigned long offset, unsigned long length, const char* buffer );
 int fat_remove( FAT_NODE* file );
+int fat_open( const FAT_NODE* node, FAT_FILE* file );
+int fat_close( FAT_FILE* file );
+int fat_file_read( FAT_FILE* file, unsigned long length, char* buffer );
+int fat_file_write( FAT_FILE* file, unsigned long length, const char* buffer );
+int fat_file_seek( FAT_FILE* file, unsigned long position );
+int fat_file_flush( FAT_FILE* file );
 int fat_df( FAT_FILESYSTEM* fs, UINT32* totalSectors, UINT32* usedSectors );
+void fat_batch_begin( FAT_FILESYSTEM* fs, FAT_BATCH* batch );
+int fat_batch_set( FAT_BATCH* batch, DWORD cluster, DWORD value );
+int fat_batch_commit( FAT_BATCH* batch );
+void fat_batch_abort( FAT_BATCH* batch );
+
+/* FAT entry and data sector access below the node API */
+DWORD get_fat( FAT_FILESYSTEM* fs, SECTOR cluster );
+int set_fat( FAT_FILESYSTEM* fs, SECTOR cluster, DWORD value );
+SECTOR alloc_free_cluster( FAT_FILESYSTEM* fs, SECTOR goal );
+int read_data_sector( FAT_FILESYSTEM* fs, SECTOR clusterNumber, SECTOR sectorNumber, BYTE* sector );
+int write_data_sector( FAT_FILESYSTEM* fs, SECTOR clusterNumber, SECTOR sectorNumber, const BYTE* sector );
 
 #endif
 
@@ -26,6 +26,15 @@ typedef struct
 	BYTE	attribute;
 } PRIVATE_FAT_ENTRY;
 
+/* what SHELL_DIR.pdata points to, the entries of the current sector are handed out one by one */
+typedef struct
+{
+	FAT_DIR		cursor;
+	FAT_DIRENT	entries[FAT_DIR_BATCH];
+	int			count;
+	int			next;
+} PRIVATE_FAT_DIR;
+
 char* my_strncpy( char* dest, const char* src, int length ) 
 // FAT시스템에선 문자열의 끝을 0x20 즉, 스페이스로 구분함 따라서 
 // 문자열 관리 함수 직접 만들어야 함.
@@ -124,7 +133,8 @@ int fs_remove( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_E
 	FAT_NODE	file;
 
 	shell_entry_to_fat_entry( parent, &FATParent );
-	fat_lookup( &FATParent, name, &file );
+	if( fat_lookup_path( &FATParent, name, &file ) ) // name은 경로일 수 있음
+		return FAT_ERROR;
 
 	return fat_remove( &file );
 }
@@ -141,10 +151,21 @@ int	fs_read( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENT
 int	fs_write( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENTRY* parent, SHELL_ENTRY* entry, unsigned long offset, unsigned long length, const char* buffer )
 {
 	FAT_NODE	FATEntry;
+	FAT_FILE	file;
+	int			result;
 
 	shell_entry_to_fat_entry( entry, &FATEntry );
+	if( fat_open( &FATEntry, &file ) )
+		return FAT_ERROR;
+
+	fat_file_seek( &file, offset );
+	result = fat_file_write( &file, length, buffer );
+	if( fat_close( &file ) ) // 모아둔 쓰기와 entry를 저장
+		return FAT_ERROR;
 
-	return fat_write( &FATEntry, offset, length, buffer );
+	fat_entry_to_shell_entry( &file.node, entry ); // 바뀐 크기와 first cluster를 반영
+
+	return result;
 }
 
 static SHELL_FILE_OPERATIONS g_file =
@@ -162,54 +183,58 @@ int fs_stat( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, unsigned int* t
 	return fat_df( FSOPRS_TO_FATFS( fsOprs ), totalSectors, usedSectors );
 }
 
-int adder( void* list, FAT_NODE* entry )
+int fs_open_dir( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENTRY* parent, SHELL_DIR* dir )
 {
-	SHELL_ENTRY_LIST*	entryList = ( SHELL_ENTRY_LIST* )list;
-	SHELL_ENTRY			newEntry;
+	PRIVATE_FAT_DIR*	fatDir;
+	FAT_NODE			entry;
 
-	fat_entry_to_shell_entry( entry, &newEntry );
+	fatDir = ( PRIVATE_FAT_DIR* )malloc( sizeof( PRIVATE_FAT_DIR ) );
+	if( fatDir == NULL )
+		return FAT_ERROR;
 
-	add_entry_list( entryList, &newEntry );
+	shell_entry_to_fat_entry( parent, &entry );
+	fat_opendir( &entry, &fatDir->cursor );
+	fatDir->count = 0;
+	fatDir->next = 0;
+	dir->pdata = fatDir;
 
 	return FAT_SUCCESS;
 }
 
-int fs_read_dir( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENTRY* parent, SHELL_ENTRY_LIST* list )
+/* returns 1 with the next entry, 0 at the end of the directory, a negative value on an error */
+int fs_read_dir_next( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, SHELL_DIR* dir, SHELL_ENTRY* entry )
 {
-	FAT_NODE	entry;
+	PRIVATE_FAT_DIR*	fatDir = ( PRIVATE_FAT_DIR* )dir->pdata;
+	FAT_NODE			node;
+	int					result;
 
-	if( list->count )
-		release_entry_list( list ); //리스트 free하는건데 처음엔 count안정해져서 넘어가
+	if( fatDir->next == fatDir->count )
+	{ // 다음 sector의 entry들
+		result = fat_readdir_next( &fatDir->cursor, fatDir->entries, FAT_DIR_BATCH );
+		fatDir->count = ( result > 0 ? result : 0 );
+		fatDir->next = 0;
+		if( result <= 0 )
+			return result;
+	}
 
-	shell_entry_to_fat_entry( parent, &entry );
-	fat_read_dir( &entry, adder, list );
+	node.fs = fatDir->cursor.fs;
+	node.entry = fatDir->entries[fatDir->next].entry;
+	node.location = fatDir->entries[fatDir->next].location;
+	fatDir->next++;
 
-	return FAT_SUCCESS;
+	fat_entry_to_shell_entry( &node, entry );
+
+	return 1;
 }
 
-int is_exist( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENTRY* parent, const char* name )
+void fs_close_dir( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, SHELL_DIR* dir )
 {
-	SHELL_ENTRY_LIST		list;
-	SHELL_ENTRY_LIST_ITEM*	current;
+	if( dir->pdata == NULL )
+		return;
 
-	init_entry_list( &list );
-
-	fs_read_dir( disk, fsOprs, parent, &list );
-	current = list.first;
-
-	while( current )				/* is directory already exist? */
-	{
-		if( my_strnicmp( current->entry.name, name, 12 ) == 0 )
-		{
-			release_entry_list( &list );
-			return FAT_ERROR;		/* the directory is already exist */
-		}
-
-		current = current->next;
-	}
-
-	release_entry_list( &list );
-	return FAT_SUCCESS;
+	fat_closedir( &( ( PRIVATE_FAT_DIR* )dir->pdata )->cursor );
+	free( dir->pdata );
+	dir->pdata = NULL;
 }
 
 int fs_mkdir( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENTRY* parent, const char* name, SHELL_ENTRY* retEntry )
@@ -218,9 +243,6 @@ int fs_mkdir( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_EN
 	FAT_NODE		FATEntry; //shell entry
 	int					result;
 	
-	if( is_exist( disk, fsOprs, parent, name ) )
-		return FAT_ERROR;
-
 	shell_entry_to_fat_entry( parent, &FATParent ); // FATParent = parent->pdata
 
 	result = fat_mkdir( &FATParent, name, &FATEntry );
@@ -230,6 +252,16 @@ int fs_mkdir( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_EN
 	return result;
 }
 
+/* creates 'count' directories under parent at once */
+int fs_mkdir_batch( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENTRY* parent, const char* const* names, unsigned int count )
+{
+	FAT_NODE	FATParent;
+
+	shell_entry_to_fat_entry( parent, &FATParent );
+
+	return fat_mkdir_batch( &FATParent, names, count, NULL );
+}
+
 int fs_rmdir( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENTRY* parent, const char* name )
 {
 	FAT_NODE	FATParent;
@@ -257,14 +289,35 @@ int fs_lookup( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_E
 	return result;
 }
 
+/* 'path' is relative to parent, or absolute if it begins with '/' */
+int fs_lookup_path( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, const SHELL_ENTRY* parent, SHELL_ENTRY* entry, const char* path )
+{
+	FAT_NODE	FATParent;
+	FAT_NODE	FATEntry;
+	int				result;
+
+	shell_entry_to_fat_entry( parent, &FATParent );
+
+	result = fat_lookup_path( &FATParent, path, &FATEntry );
+	if( result == FAT_SUCCESS )
+		fat_entry_to_shell_entry( &FATEntry, entry );
+
+	return result;
+}
+
 static SHELL_FS_OPERATIONS	g_fsOprs =
 {
-	fs_read_dir,
+	fs_open_dir,
+	fs_read_dir_next,
+	fs_close_dir,
 	fs_stat,
 	fs_mkdir,
+	fs_mkdir_batch,
 	fs_rmdir,
 	fs_lookup,
+	fs_lookup_path,
 	&g_file,
+	sizeof( FAT_NODE ),
 	NULL
 };
 
@@ -280,6 +333,9 @@ int fs_mount( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, SHELL_ENTRY* r
 	*fsOprs = g_fsOprs;
 	// main의 g_fs에 mount하려는 파일 시스템 operation함수를 등록해줌
 
+	if( fsOprs->nodeSize > SHELL_ENTRY_PDATA_SIZE )
+		return -1; // FAT_NODE가 SHELL_ENTRY에 들어가지 않음
+
 	fsOprs->pdata = malloc( sizeof( FAT_FILESYSTEM ) ); 
 	fat = FSOPRS_TO_FATFS( fsOprs ); //fat = fsOprs->pdata
 	//메모리 할당, 파일 시스템 할당 
@@ -319,15 +375,19 @@ int fs_mount( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs, SHELL_ENTRY* r
 	return result;
 }
 
-void fs_umount( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs )
+int fs_umount( DISK_OPERATIONS* disk, SHELL_FS_OPERATIONS* fsOprs )
 {
+	int		result = FAT_SUCCESS;
+
 	if( fsOprs && fsOprs->pdata )
 	{
-		fat_umount( FSOPRS_TO_FATFS( fsOprs ) ); //fsOprs->pdata->클러스트 리스트 초기화
+		result = fat_umount( FSOPRS_TO_FATFS( fsOprs ) ); //fsOprs->pdata->클러스트 리스트 초기화
 
 		free( fsOprs->pdata ); // fsOprs->pdata 할당해제
 		fsOprs->pdata = 0;
 	}
+
+	return result;
 }
 
 int fs_format( DISK_OPERATIONS* disk, void* param ) 
@@ -0,0 +1,545 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : fat_test.c                                                       */
+/* Notes   : Behavior tests of the FAT layer on a simulated disk              */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fat.h"
+#include "disksim.h"
+
+#define TEST_SECTORS			20000	/* smallest disk the formatter makes a FAT16 of */
+#define TEST_FAT12_SECTORS		4096
+#define TEST_APPENDS			1000
+#define TEST_APPEND_SIZE		100
+
+#define CHECK( cond )			check( cond, #cond, __LINE__ )
+
+int				g_failures;
+
+/* every test starts from a copy of a formatted image disk. The test disk counts
+ * writes and fails the g_failAt'th one, -1 never fails */
+DISK_OPERATIONS	g_imageDisk;
+DISK_OPERATIONS	g_fat12ImageDisk;
+DISK_OPERATIONS	g_realDisk;
+int				g_failAt = -1;
+int				g_writes;
+
+void check( int cond, const char* text, int line )
+{
+	if( cond )
+		return;
+
+	printf( "%s(%d): %s failed\n", __FILE__, line, text );
+	g_failures++;
+}
+
+int counting_write_sector( DISK_OPERATIONS* disk, SECTOR sector, const void* data )
+{
+	if( g_writes++ == g_failAt )
+		return -1;
+
+	return g_realDisk.write_sector( &g_realDisk, sector, data );
+}
+
+int counting_write_sectors( DISK_OPERATIONS* disk, SECTOR sector, SECTOR count, const void* data, const DISK_IOVEC* iov, int iovCount )
+{
+	if( g_writes++ == g_failAt )
+		return -1;
+
+	return g_realDisk.write_sectors( &g_realDisk, sector, count, data, iov, iovCount );
+}
+
+int init_test_disks( void )
+{
+	if( disksim_init( TEST_SECTORS, 512, &g_imageDisk ) || disksim_init( TEST_SECTORS, 512, &g_realDisk ) ||
+		disksim_init( TEST_FAT12_SECTORS, 512, &g_fat12ImageDisk ) )
+		return FAT_ERROR;
+
+	if( fat_format( &g_imageDisk, FAT16 ) )
+		return FAT_ERROR;
+
+	return fat_format( &g_fat12ImageDisk, FAT12 );
+}
+
+/* restores a formatted image and mounts it through the counting operations */
+FAT_FILESYSTEM* mount_test_image( DISK_OPERATIONS* image, DISK_OPERATIONS* disk, FAT_NODE* root, UINT32 cacheSize )
+{
+	FAT_FILESYSTEM*	fs;
+	BYTE			data[MAX_SECTOR_SIZE];
+	SECTOR			sector;
+
+	for( sector = 0; sector < image->numberOfSectors; sector++ )
+	{
+		image->read_sector( image, sector, data );
+		g_realDisk.write_sector( &g_realDisk, sector, data );
+	}
+
+	*disk = g_realDisk;
+	disk->numberOfSectors	= image->numberOfSectors;
+	disk->write_sector	= counting_write_sector;
+	disk->write_sectors	= counting_write_sectors;
+	g_failAt = -1;
+
+	fs = ( FAT_FILESYSTEM* )calloc( 1, sizeof( FAT_FILESYSTEM ) );
+	fs->disk = disk;
+	fs->cacheSize = cacheSize;
+	if( fat_read_superblock( fs, root ) )
+	{
+		free( fs );
+		return NULL;
+	}
+
+	return fs;
+}
+
+FAT_FILESYSTEM* mount_test_disk( DISK_OPERATIONS* disk, FAT_NODE* root, UINT32 cacheSize )
+{
+	return mount_test_image( &g_imageDisk, disk, root, cacheSize );
+}
+
+/* mounts the test disk again as the last umount left it */
+FAT_FILESYSTEM* remount_test_disk( FAT_FILESYSTEM* fs, DISK_OPERATIONS* disk, FAT_NODE* root, UINT32 cacheSize )
+{
+	fat_umount( fs );
+	ZeroMemory( fs, sizeof( FAT_FILESYSTEM ) );
+	fs->disk = disk;
+	fs->cacheSize = cacheSize;
+	if( fat_read_superblock( fs, root ) )
+	{
+		free( fs );
+		return NULL;
+	}
+
+	return fs;
+}
+
+void umount_test_disk( FAT_FILESYSTEM* fs )
+{
+	fat_umount( fs );
+	free( fs );
+}
+
+UINT32 count_free_entries( FAT_FILESYSTEM* fs )
+{
+	UINT32	cluster, count = 0;
+
+	for( cluster = 2; cluster < fs->fatEntries; cluster++ )
+		count += ( get_fat( fs, cluster ) == FREE_CLUSTER );
+
+	return count;
+}
+
+/* true if the free cluster bitmap says the same as the FAT about every cluster */
+int bitmap_matches_fat( FAT_FILESYSTEM* fs )
+{
+	UINT32	cluster;
+
+	for( cluster = 2; cluster < fs->fatEntries; cluster++ )
+	{
+		if( is_cluster_free( &fs->freeClusterMap, cluster ) != ( get_fat( fs, cluster ) == FREE_CLUSTER ) )
+			return 0;
+	}
+
+	return fs->freeClusterMap.freeCount == count_free_entries( fs );
+}
+
+UINT32 chain_length( FAT_FILESYSTEM* fs, DWORD cluster )
+{
+	UINT32	length = 0;
+
+	while( cluster >= 2 && !is_type_eoc( fs->typeInfo, cluster ) && length < fs->fatEntries )
+	{
+		length++;
+		cluster = get_fat( fs, cluster );
+	}
+
+	return length;
+}
+
+int count_dir_entries( FAT_NODE* dir, UINT32 max )
+{
+	FAT_DIR		cursor;
+	FAT_DIRENT	entries[16];
+	int			count = 0, result;
+
+	fat_opendir( dir, &cursor );
+	while( ( result = fat_readdir_next( &cursor, entries, max ) ) > 0 )
+		count += result;
+	fat_closedir( &cursor );
+
+	return ( result < 0 ? result : count );
+}
+
+/* first cluster whose FAT12 entry has its low byte at the end of a FAT sector */
+SECTOR straddling_cluster( FAT_FILESYSTEM* fs )
+{
+	SECTOR	cluster;
+
+	for( cluster = 2; cluster < fs->fatEntries; cluster++ )
+	{
+		if( ( cluster + cluster / 2 ) % fs->bpb.bytesPerSector == fs->bpb.bytesPerSector - 1 )
+			return cluster;
+	}
+
+	return 0;
+}
+
+/* FAT12 entries survive a remount, including the ones split over two FAT sectors */
+void test_fat12_round_trip( void )
+{
+	DISK_OPERATIONS	disk;
+	FAT_FILESYSTEM*	fs;
+	FAT_NODE		root;
+	SECTOR			cluster, straddling;
+	UINT32			mismatches = 0;
+
+	fs = mount_test_image( &g_fat12ImageDisk, &disk, &root, 1 );
+	CHECK( fs != NULL && fs->FATType == FAT12 );
+	if( fs == NULL )
+		return;
+
+	straddling = straddling_cluster( fs );
+	CHECK( straddling != 0 );
+
+	for( cluster = 2; cluster < fs->fatEntries; cluster++ )
+		set_fat( fs, cluster, ( cluster * 7 + 3 ) & 0xFFF );
+
+	fs = remount_test_disk( fs, &disk, &root, 1 );
+	CHECK( fs != NULL );
+	if( fs == NULL )
+		return;
+
+	for( cluster = 2; cluster < fs->fatEntries; cluster++ )
+		mismatches += ( get_fat( fs, cluster ) != ( ( cluster * 7 + 3 ) & 0xFFF ) );
+	CHECK( mismatches == 0 );
+
+	/* only the split entry changes, so both of its sectors must be marked dirty */
+	set_fat( fs, straddling, 0xABC );
+	fs = remount_test_disk( fs, &disk, &root, 1 );
+	CHECK( fs != NULL );
+	if( fs == NULL )
+		return;
+
+	CHECK( get_fat( fs, straddling ) == 0xABC );
+	CHECK( get_fat( fs, straddling - 1 ) == ( ( ( straddling - 1 ) * 7 + 3 ) & 0xFFF ) );
+	CHECK( get_fat( fs, straddling + 1 ) == ( ( ( straddling + 1 ) * 7 + 3 ) & 0xFFF ) );
+
+	umount_test_disk( fs );
+}
+
+/* every update reaches the bitmap, and only the last one of a cluster counts */
+void test_batch_commit( void )
+{
+	DISK_OPERATIONS	disk;
+	FAT_FILESYSTEM*	fs;
+	FAT_NODE		root;
+	FAT_BATCH		batch;
+	SECTOR			a, b;
+	UINT32			c;
+
+	fs = mount_test_disk( &disk, &root, 0 );
+	CHECK( fs != NULL );
+	if( fs == NULL )
+		return;
+
+	a = alloc_free_cluster( fs, 0 );
+	b = alloc_free_cluster( fs, 0 );
+	set_fat( fs, a, fs->typeInfo->MS_EOC );
+	set_fat( fs, b, fs->typeInfo->MS_EOC );
+	CHECK( find_free_cluster( &fs->freeClusterMap, b + 1, &c ) == FAT_SUCCESS );
+
+	fat_batch_begin( fs, &batch );
+	fat_batch_set( &batch, a, FREE_CLUSTER );
+	fat_batch_set( &batch, a, b );				/* freed and reused in one batch */
+	fat_batch_set( &batch, b, FREE_CLUSTER );
+	fat_batch_set( &batch, c, fs->typeInfo->MS_EOC );	/* a free cluster which becomes used */
+	CHECK( fat_batch_commit( &batch ) == FAT_SUCCESS );
+
+	CHECK( get_fat( fs, a ) == b );
+	CHECK( !is_cluster_free( &fs->freeClusterMap, a ) );
+	CHECK( get_fat( fs, b ) == FREE_CLUSTER );
+	CHECK( is_cluster_free( &fs->freeClusterMap, b ) );
+	CHECK( !is_cluster_free( &fs->freeClusterMap, c ) );
+	CHECK( bitmap_matches_fat( fs ) );
+
+	umount_test_disk( fs );
+}
+
+int is_hole( const FAT_ENTRY_LOCATION* location, const FAT_ENTRY_LOCATION* holes )
+{
+	return !memcmp( location, &holes[0], sizeof( FAT_ENTRY_LOCATION ) ) || !memcmp( location, &holes[1], sizeof( FAT_ENTRY_LOCATION ) );
+}
+
+/* new entries fill the holes of removed ones before the directory grows */
+void test_hole_reuse( void )
+{
+	DISK_OPERATIONS		disk;
+	FAT_FILESYSTEM*		fs;
+	FAT_NODE			root, dir, node;
+	FAT_ENTRY_LOCATION	holes[2], created;
+	FAT_DIR				cursor;
+	FAT_DIRENT			entries[16];
+	char				name[16];
+	UINT32				chain;
+	int					i;
+
+	fs = mount_test_disk( &disk, &root, 0 );
+	CHECK( fs != NULL );
+	if( fs == NULL )
+		return;
+
+	fat_mkdir( &root, "DIR", &dir );
+	fat_lookup( &root, "DIR", &dir );
+
+	fat_opendir( &dir, &cursor ); // 새 디렉토리는 '.'과 '..'만 연속으로 가짐
+	CHECK( fat_readdir_next( &cursor, entries, 16 ) == 2 );
+	CHECK( entries[0].location.number == 0 && entries[1].location.number == 1 );
+	fat_closedir( &cursor );
+
+	for( i = 0; i < 100; i++ )
+	{
+		sprintf( name, "F%d", i );
+		fat_create( &dir, name, &node );
+	}
+	chain = chain_length( fs, GET_FIRST_CLUSTER( dir.entry ) );
+
+	fat_lookup( &dir, "F10", &node );
+	holes[0] = node.location;
+	fat_remove( &node );
+	fat_lookup( &dir, "F70", &node );
+	holes[1] = node.location;
+	fat_remove( &node );
+
+	CHECK( fat_create( &dir, "NEW1", &node ) == FAT_SUCCESS );
+	CHECK( is_hole( &node.location, holes ) );
+	created = node.location;
+	CHECK( fat_create( &dir, "NEW2", &node ) == FAT_SUCCESS );
+	CHECK( is_hole( &node.location, holes ) && memcmp( &node.location, &created, sizeof( FAT_ENTRY_LOCATION ) ) );
+
+	CHECK( chain_length( fs, GET_FIRST_CLUSTER( dir.entry ) ) == chain );
+	CHECK( count_dir_entries( &dir, 16 ) == 2 + 100 );
+	CHECK( fat_lookup( &dir, "F10", &node ) == FAT_ERROR );
+	CHECK( fat_lookup( &dir, "NEW2", &node ) == FAT_SUCCESS );
+
+	umount_test_disk( fs );
+}
+
+/* a batch create which fails at any disk write leaves the directory and the FAT as they were */
+void test_batch_create_rollback( void )
+{
+	DISK_OPERATIONS	disk;
+	FAT_FILESYSTEM*	fs;
+	FAT_NODE		root, dir, node;
+	char			names[40][8];
+	const char*		list[40];
+	UINT32			freeCount, chain;
+	int				entries, failAt, i, result = FAT_ERROR;
+
+	for( i = 0; i < 40; i++ )
+	{
+		sprintf( names[i], "N%d", i );
+		list[i] = names[i];
+	}
+
+	for( failAt = 0; result != FAT_SUCCESS; failAt++ )
+	{
+		fs = mount_test_disk( &disk, &root, 3 ); // 쓰기가 바로 디스크에 가도록 작은 cache
+		CHECK( fs != NULL );
+		if( fs == NULL )
+			return;
+
+		fat_mkdir( &root, "P", &dir );
+		fat_lookup( &root, "P", &dir );
+		for( i = 0; i < 20; i++ )
+		{
+			sprintf( names[0], "O%d", i );
+			fat_create( &dir, names[0], &node );
+		}
+		for( i = 0; i < 20; i += 3 ) // 구멍을 만들어 둠
+		{
+			sprintf( names[0], "O%d", i );
+			fat_lookup( &dir, names[0], &node );
+			fat_remove( &node );
+		}
+		strcpy( names[0], "N0" );
+
+		freeCount	= fs->freeClusterMap.freeCount;
+		chain		= chain_length( fs, GET_FIRST_CLUSTER( dir.entry ) );
+		entries		= count_dir_entries( &dir, 16 );
+
+		g_writes = 0;
+		g_failAt = failAt;
+		result = fat_mkdir_batch( &dir, list, 40, NULL );
+		g_failAt = -1;
+
+		if( result == FAT_SUCCESS )
+			CHECK( count_dir_entries( &dir, 16 ) == entries + 40 );
+		else
+		{
+			CHECK( fs->freeClusterMap.freeCount == freeCount );
+			CHECK( chain_length( fs, GET_FIRST_CLUSTER( dir.entry ) ) == chain );
+			CHECK( count_dir_entries( &dir, 16 ) == entries );
+			for( i = 0; i < 40; i++ )
+				CHECK( fat_lookup( &dir, names[i], &node ) == FAT_ERROR );
+		}
+		CHECK( bitmap_matches_fat( fs ) );
+
+		umount_test_disk( fs );
+	}
+
+	CHECK( failAt > 1 );
+}
+
+/* every batch size yields the same entries, and a cyclic chain ends the listing with an error */
+void test_dir_iterator( void )
+{
+	DISK_OPERATIONS	disk;
+	FAT_FILESYSTEM*	fs;
+	FAT_NODE		root, dir, node;
+	FAT_DIR			cursor;
+	FAT_DIRENT		entries[16];
+	BYTE			data[MAX_SECTOR_SIZE];
+	char			name[16];
+	DWORD			first, last;
+	UINT32			max, sector;
+	int				i, result, calls = 0;
+
+	fs = mount_test_disk( &disk, &root, 0 );
+	CHECK( fs != NULL );
+	if( fs == NULL )
+		return;
+
+	fat_mkdir( &root, "SUB", &dir );
+	fat_lookup( &root, "SUB", &dir );
+	for( i = 0; i < 300; i++ )
+	{
+		sprintf( name, "F%d", i );
+		fat_create( &dir, name, &node );
+	}
+	for( i = 0; i < 300; i += 3 )
+	{
+		sprintf( name, "F%d", i );
+		fat_lookup( &dir, name, &node );
+		fat_remove( &node );
+	}
+
+	for( max = 1; max <= 16; max += 5 )
+		CHECK( count_dir_entries( &dir, max ) == 2 + 200 );
+
+	fat_opendir( &dir, &cursor );
+	CHECK( fat_readdir_next( &cursor, entries, 2 ) == 2 );
+	CHECK( entries[0].entry.name[0] == '.' && entries[1].entry.name[1] == '.' );
+	fat_closedir( &cursor );
+	CHECK( fat_readdir_next( &cursor, entries, 2 ) == 0 );
+
+	/* without an end marker the listing follows the chain back to its first cluster */
+	first = last = GET_FIRST_CLUSTER( dir.entry );
+	while( !is_type_eoc( fs->typeInfo, get_fat( fs, last ) ) )
+		last = get_fat( fs, last );
+	for( sector = 0; sector < fs->bpb.sectorsPerCluster; sector++ )
+	{
+		read_data_sector( fs, last, sector, data );
+		for( i = 0; i < fs->bpb.bytesPerSector; i += sizeof( FAT_DIR_ENTRY ) )
+		{
+			if( data[i] == DIR_ENTRY_NO_MORE )
+				data[i] = DIR_ENTRY_FREE;
+		}
+		write_data_sector( fs, last, sector, data );
+	}
+	set_fat( fs, last, first );
+
+	fat_opendir( &dir, &cursor );
+	while( ( result = fat_readdir_next( &cursor, entries, 16 ) ) > 0 && calls < 100000 )
+		calls++;
+	fat_closedir( &cursor );
+	CHECK( result == FAT_ERROR );
+
+	set_fat( fs, last, fs->typeInfo->MS_EOC );
+	umount_test_disk( fs );
+}
+
+/* small appends through a handle reach the disk as whole sectors, with the same content */
+void test_write_coalescing( void )
+{
+	DISK_OPERATIONS	disk;
+	FAT_FILESYSTEM*	fs;
+	FAT_NODE		root, node;
+	FAT_FILE		file;
+	char*			expected;
+	char*			data;
+	UINT32			size = TEST_APPENDS * TEST_APPEND_SIZE;
+	int				i;
+
+	fs = mount_test_disk( &disk, &root, 1 ); // buffer cache가 쓰기를 모으지 않도록
+	CHECK( fs != NULL );
+	if( fs == NULL )
+		return;
+
+	expected	= ( char* )malloc( size );
+	data		= ( char* )malloc( size );
+	for( i = 0; i < ( int )size; i++ )
+		expected[i] = ( char )( i * 7 + i / 13 );
+
+	fat_create( &root, "APP.DAT", &node );
+	fat_open( &node, &file );
+
+	g_writes = 0;
+	for( i = 0; i < TEST_APPENDS; i++ )
+		CHECK( fat_file_write( &file, TEST_APPEND_SIZE, &expected[i * TEST_APPEND_SIZE] ) == TEST_APPEND_SIZE );
+	CHECK( fat_close( &file ) == FAT_SUCCESS );
+	CHECK( fat_sync( fs ) == FAT_SUCCESS );
+	CHECK( g_writes < TEST_APPENDS / 4 ); // append마다 쓰지 않음
+
+	fs = remount_test_disk( fs, &disk, &root, 0 );
+	CHECK( fs != NULL );
+	if( fs == NULL )
+	{
+		free( data );
+		free( expected );
+		return;
+	}
+
+	CHECK( fat_lookup( &root, "APP.DAT", &node ) == FAT_SUCCESS );
+	CHECK( node.entry.fileSize == size );
+	CHECK( fat_read( &node, 0, size, data ) == ( int )size );
+	CHECK( !memcmp( data, expected, size ) );
+
+	free( data );
+	free( expected );
+	umount_test_disk( fs );
+}
+
+int main( void )
+{
+	if( init_test_disks() )
+	{
+		printf( "Cannot format the test disk\n" );
+		return 1;
+	}
+
+	test_fat12_round_trip();
+	test_batch_commit();
+	test_hole_reuse();
+	test_batch_create_rollback();
+	test_dir_iterator();
+	test_write_coalescing();
+
+	disksim_uninit( &g_realDisk );
+	disksim_uninit( &g_imageDisk );
+	disksim_uninit( &g_fat12ImageDisk );
+
+	if( g_failures )
+	{
+		printf( "%d checks failed\n", g_failures );
+		return 1;
+	}
+
+	printf( "All tests passed\n" );
+	return 0;
+}
@@ -0,0 +1,96 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : fatscan.c                                                        */
+/* Notes   : FAT region decoding kernels                                      */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include "common.h"
+#include "fatscan.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* 3 bytes hold two 12bit entries, so they are unpacked a pair at a time */
+UINT64 scan_fat12( const BYTE* src, DWORD* table, UINT32 count )
+{
+	UINT64	freeBits = 0;
+	UINT32	i;
+
+	for( i = 0; i + 2 <= count; i += 2, src += 3 )
+	{
+		table[i]		= src[0] | ( ( src[1] & 0x0F ) << 8 );
+		table[i + 1]	= ( src[1] >> 4 ) | ( src[2] << 4 );
+
+		freeBits |= ( ( UINT64 )( table[i] == 0 ) << i ) | ( ( UINT64 )( table[i + 1] == 0 ) << ( i + 1 ) );
+	}
+
+	if( i < count ) // 홀수개면 마지막 하나
+	{
+		table[i] = src[0] | ( ( src[1] & 0x0F ) << 8 );
+		freeBits |= ( UINT64 )( table[i] == 0 ) << i;
+	}
+
+	return freeBits;
+}
+
+UINT64 scan_fat16( const BYTE* src, DWORD* table, UINT32 count )
+{
+	UINT64	freeBits = 0;
+	UINT32	i = 0;
+
+#ifdef __SSE2__
+	const __m128i	zero = _mm_setzero_si128();
+
+	/* 8 entries per step: widen to 32 bits for the table and compare with zero */
+	for( ; i + 8 <= count; i += 8 )
+	{
+		__m128i	v = _mm_loadu_si128( ( const __m128i* )( src + i * 2 ) );
+
+		_mm_storeu_si128( ( __m128i* )( table + i ), _mm_unpacklo_epi16( v, zero ) );
+		_mm_storeu_si128( ( __m128i* )( table + i + 4 ), _mm_unpackhi_epi16( v, zero ) );
+
+		freeBits |= ( UINT64 )_mm_movemask_epi8( _mm_packs_epi16( _mm_cmpeq_epi16( v, zero ), zero ) ) << i;
+	}
+#endif
+
+	for( ; i < count; i++ )
+	{
+		table[i] = src[i * 2] | ( src[i * 2 + 1] << 8 );
+		freeBits |= ( UINT64 )( table[i] == 0 ) << i;
+	}
+
+	return freeBits;
+}
+
+UINT64 scan_fat32( const BYTE* src, DWORD* table, UINT32 count )
+{
+	UINT64	freeBits = 0;
+	UINT32	i = 0;
+
+#ifdef __SSE2__
+	const __m128i	zero = _mm_setzero_si128();
+	const __m128i	mask = _mm_set1_epi32( 0x0FFFFFFF );
+
+	/* 4 entries per step, the top 4 bits are reserved and ignored by the free test */
+	for( ; i + 4 <= count; i += 4 )
+	{
+		__m128i	v = _mm_loadu_si128( ( const __m128i* )( src + i * 4 ) );
+
+		_mm_storeu_si128( ( __m128i* )( table + i ), v );
+
+		freeBits |= ( UINT64 )_mm_movemask_ps( _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( v, mask ), zero ) ) ) << i;
+	}
+#endif
+
+	for( ; i < count; i++ )
+	{
+		table[i] = src[i * 4] | ( src[i * 4 + 1] << 8 ) | ( src[i * 4 + 2] << 16 ) | ( ( DWORD )src[i * 4 + 3] << 24 );
+		freeBits |= ( UINT64 )( ( table[i] & 0x0FFFFFFF ) == 0 ) << i;
+	}
+
+	return freeBits;
+}
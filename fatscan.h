@@ -0,0 +1,26 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : fatscan.h                                                        */
+/* Notes   : FAT region decoding kernels header                               */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef _FATSCAN_H_
+#define _FATSCAN_H_
+
+#include "common.h"
+
+#define FAT_SCAN_GROUP			64		/* entries decoded per kernel call, one bit each in the result */
+
+/*
+ * Each kernel decodes up to FAT_SCAN_GROUP little endian FAT entries from 'src'
+ * into 'table' and returns a mask with bit i set when entry i is free.
+ * For FAT12, 'src' has to start at an even entry (a 3 byte boundary).
+ */
+UINT64	scan_fat12( const BYTE* src, DWORD* table, UINT32 count );
+UINT64	scan_fat16( const BYTE* src, DWORD* table, UINT32 count );
+UINT64	scan_fat32( const BYTE* src, DWORD* table, UINT32 count );
+
+#endif
@@ -0,0 +1,30 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : fattype.c                                                        */
+/* Notes   : FAT12/16/32 entry access operations                              */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#include "fat.h"
+#include "fattype.h"
+
+const FAT_TYPE_INFO	fat12_type_info = { FAT12, 0x0FFF, 0, 3, EOC12, MS_EOC12 };
+const FAT_TYPE_INFO	fat16_type_info = { FAT16, 0xFFFF, 0, 4, EOC16, MS_EOC16 };
+const FAT_TYPE_INFO	fat32_type_info = { FAT32, 0x0FFFFFFF, 0xF0000000, 8, EOC32, MS_EOC32 };
+
+const FAT_TYPE_INFO* get_fat_type_info( BYTE FATType )
+{
+	switch( FATType )
+	{
+	case FAT12:
+		return &fat12_type_info;
+	case FAT16:
+		return &fat16_type_info;
+	case FAT32:
+		return &fat32_type_info;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,67 @@
+/******************************************************************************/
+/*                                                                            */
+/* Project : FAT12/16/32 File System                                          */
+/* File    : fattype.h                                                        */
+/* Notes   : FAT12/16/32 entry access operations header                       */
+/* Date    : 2026/10/17                                                       */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef _FATTYPE_H_
+#define _FATTYPE_H_
+
+#include "common.h"
+
+/*
+ * Constants of one FAT width, bound to the file system at mount. The entry
+ * access kernels below take them as arguments instead of switching on the FAT
+ * type, so they inline into their callers and a loop loads the constants once.
+ */
+typedef struct
+{
+	BYTE	FATType;
+	DWORD	mask;			/* bits of an entry holding the cluster number */
+	DWORD	reserved;		/* bits kept when an entry is stored, the top 4 bits of FAT32 */
+	DWORD	entryNibbles;	/* size of an entry in the FAT in 4 bit units, 3, 4 or 8 */
+	DWORD	EOC;			/* values from here on mark the end of a chain */
+	DWORD	MS_EOC;			/* end of chain mark written by this file system */
+} FAT_TYPE_INFO;
+
+static inline DWORD get_type_entry( const FAT_TYPE_INFO* type, const DWORD* table, DWORD cluster )
+{
+	return table[cluster] & type->mask;
+}
+
+static inline void store_type_entry( const FAT_TYPE_INFO* type, DWORD* table, DWORD cluster, DWORD value )
+{
+	table[cluster] = ( table[cluster] & type->reserved ) | ( value & type->mask );
+}
+
+/* byte offset of the entry of 'cluster' in the FAT, cluster * 1.5, 2 or 4 */
+static inline DWORD get_type_entry_offset( const FAT_TYPE_INFO* type, DWORD cluster )
+{
+	return cluster * type->entryNibbles / 2;
+}
+
+static inline int is_type_eoc( const FAT_TYPE_INFO* type, DWORD value )
+{
+	return ( value & type->mask ) >= type->EOC;
+}
+
+/* length of the physically contiguous run of a chain starting at 'cluster',
+ * the entry of its last cluster is returned in 'next' */
+static inline DWORD follow_type_run( const FAT_TYPE_INFO* type, const DWORD* table, DWORD entries, DWORD cluster, DWORD* next )
+{
+	DWORD	mask = type->mask;
+	DWORD	last = cluster;
+
+	while( last + 1 < entries && ( table[last] & mask ) == last + 1 )
+		last++;
+
+	*next = table[last] & mask;
+	return last - cluster + 1;
+}
+
+const FAT_TYPE_INFO*	get_fat_type_info( BYTE FATType );
+
+#endif
@@ -14,6 +14,7 @@
 #include <memory.h>
 #include "shell.h"
 #include "disksim.h"
+#include "diskimg.h"
 
 #define SECTOR_SIZE				512
 #define NUMBER_OF_SECTORS		4096
@@ -73,14 +74,40 @@ static SHELL_FILESYSTEM		g_fs;
 static SHELL_FS_OPERATIONS	g_fsOprs;
 static SHELL_ENTRY			g_rootDir;
 static SHELL_ENTRY			g_currentDir;
+static char					g_currentPath[256];		/* absolute path of g_currentDir, "" for the root */
 static DISK_OPERATIONS		g_disk;
+static void					( *g_diskUninit )( DISK_OPERATIONS* ) = disksim_uninit;
 
 int g_commandsCount = sizeof( g_commands ) / sizeof( COMMAND );
 int g_isMounted;
 
 int main( int argc, char* argv[] )
 {
-	if( disksim_init( NUMBER_OF_SECTORS, SECTOR_SIZE, &g_disk ) < 0 ) 
+	SECTOR			numberOfSectors = NUMBER_OF_SECTORS;
+	unsigned long	value;
+	char*			end;
+
+	if( argc >= 2 ) // shell [image file] [number of sectors] : 이미지 파일을 디스크로 사용
+	{
+		if( argc >= 3 )
+		{
+			value = strtoul( argv[2], &end, 10 );
+			if( argv[2][0] < '0' || argv[2][0] > '9' || *end != 0 || value == 0 || value > 0xFFFFFFFFUL )
+			{ // 숫자가 아니거나 0이면 크기로 쓰지 않음
+				printf( "invalid number of sectors %s\n", argv[2] );
+				return -1;
+			}
+			numberOfSectors = ( SECTOR )value;
+		}
+
+		if( diskimg_init( argv[1], numberOfSectors, SECTOR_SIZE, &g_disk ) < 0 )
+		{
+			printf( "cannot open disk image %s\n", argv[1] );
+			return -1;
+		}
+		g_diskUninit = diskimg_uninit;
+	}
+	else if( disksim_init( NUMBER_OF_SECTORS, SECTOR_SIZE, &g_disk ) < 0 )
 	{ //init 실패시
 		printf( "disk simulator initialization has been failed\n" );
 		return -1;
@@ -179,14 +206,58 @@ int seperate_string( char* buf, char* ptrs[] )
 /******************************************************************************/
 /* Shell commands...                                                          */
 /******************************************************************************/
+/* Applies 'path' to the absolute path 'base' by its text only, as the shells do.
+ * "." is dropped and ".." removes the last component. The root is "" */
+int join_path( const char* base, const char* path, char* result, int size )
+{
+	int		length, resultLength;
+	char*	slash;
+
+	if( *path == '/' )
+		result[0] = 0; // 절대 경로
+	else if( strlen( base ) < size )
+		strcpy( result, base );
+	else
+		return -1;
+
+	resultLength = strlen( result );
+	while( *path )
+	{
+		for( length = 0; path[length] && path[length] != '/'; length++ )
+			;
+
+		if( length == 0 || ( length == 1 && path[0] == '.' ) )
+			;
+		else if( length == 2 && path[0] == '.' && path[1] == '.' )
+		{
+			slash = strrchr( result, '/' ); // 마지막 component 제거, root에서는 그대로
+			resultLength = ( slash ? slash - result : 0 );
+			result[resultLength] = 0;
+		}
+		else
+		{
+			if( resultLength + 1 + length >= size )
+				return -1;
+
+			result[resultLength++] = '/';
+			memcpy( &result[resultLength], path, length );
+			resultLength += length;
+			result[resultLength] = 0;
+		}
+
+		path += length;
+		if( *path == '/' )
+			path++;
+	}
+
+	return 0;
+}
+
 int shell_cmd_cd( int argc, char* argv[] )
 {
 	SHELL_ENTRY	newEntry;
+	char		newPath[sizeof( g_currentPath )];
 	int			result;
-	static SHELL_ENTRY	path[256];
-	static int			pathTop = 0;
-
-	path[0] = g_rootDir;
 
 	if( argc > 2 ) // 명령어가 3개 이상인 경우 에러메시지
 	{
@@ -194,40 +265,44 @@ int shell_cmd_cd( int argc, char* argv[] )
 		return 0;
 	}
 
-	if( argc == 1 ) // cd만 입력한 경우 top으로 path변경
-		pathTop = 0;
+	if( argc == 1 ) // cd만 입력한 경우 root로 변경
+		newPath[0] = 0;
+	else if( join_path( g_currentPath, argv[1], newPath, sizeof( newPath ) ) )
+	{
+		printf( "path is too long\n" );
+		return -1;
+	}
+
+	if( newPath[0] == 0 )
+		newEntry = g_rootDir;
 	else
 	{
-		if( strcmp( argv[1], "." ) == 0 ) // cd . 입력 시 제자리
-			return 0;
-		else if( strcmp( argv[1], ".." ) == 0 && pathTop > 0 ) // cd .. 입력시 상위 디렉토리
-			pathTop--;
-		else
-		{
-			result = g_fsOprs.lookup( &g_disk, &g_fsOprs, &g_currentDir, &newEntry, argv[1] ); // 현재 디렉토리 내에서 입력 디렉토리 탐색
+		result = g_fsOprs.lookup_path( &g_disk, &g_fsOprs, &g_rootDir, &newEntry, newPath ); // root부터 경로를 한번에 탐색
 
-			if( result ) // 해당 디렉토리 명이 없다면
-			{
-				printf( "directory not found\n" );
-				return -1;
-			}
-			else if( !newEntry.isDirectory ) // 디렉토리가 아닌 파일명을 입력했다면
-			{
-				printf( "%s is not a directory\n", argv[1] );
-				return -1;
-			}
-			path[++pathTop] = newEntry; // path배열의 다음칸에 입력받은 디렉토리 위치 저장
+		if( result ) // 해당 디렉토리 명이 없다면
+		{
+			printf( "directory not found\n" );
+			return -1;
+		}
+		else if( !newEntry.isDirectory ) // 디렉토리가 아닌 파일명을 입력했다면
+		{
+			printf( "%s is not a directory\n", argv[1] );
+			return -1;
 		}
 	}
 
-	g_currentDir = path[pathTop];// 현재 위치를 입력받은 디렉토리로 변경
+	g_currentDir = newEntry; // 현재 위치를 입력받은 디렉토리로 변경
+	strcpy( g_currentPath, newPath );
 
 	return 0;
 }
 
 int shell_cmd_exit( int argc, char* argv[] ) // 메모리 할당 해제 및 종료
 {
-	disksim_uninit( &g_disk );
+	if( g_isMounted ) // 캐시에 남은 내용을 disk에 반영
+		shell_cmd_umount( argc, argv );
+
+	g_diskUninit( &g_disk );
 	_exit( 0 );
 
 	return 0;
@@ -245,6 +320,7 @@ int  shell_cmd_mount( int argc, char* argv[] )
 
 	result = g_fs.mount( &g_disk, &g_fsOprs, &g_rootDir ); //fs.mount --> fat_shell.h // 마운트 함수 실행
 	g_currentDir = g_rootDir; // 현재 디렉토리 = 루트디렉토리
+	g_currentPath[0] = 0;
 
 	if( result < 0 ) // 마운팅 실패시
 	{
@@ -267,7 +343,12 @@ int shell_cmd_umount( int argc, char* argv[] )
 	if( g_fs.umount == NULL ) // umount 함수 유무 검사
 		return 0;
 
-	g_fs.umount( &g_disk, &g_fsOprs ); //언마운트 함수 실행
+	if( g_fs.umount( &g_disk, &g_fsOprs ) ) //언마운트 함수 실행
+	{
+		printf( "%s file system was not written back completely\n", g_fs.name );
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -351,8 +432,10 @@ int shell_cmd_rm( int argc, char* argv[] )
 
 int shell_cmd_ls( int argc, char* argv[] )
 {
-	SHELL_ENTRY_LIST		list; 
-	SHELL_ENTRY_LIST_ITEM*	current; // It has entry and next
+	SHELL_DIR		cursor;
+	SHELL_ENTRY		entry;
+	SHELL_ENTRY		dir = g_currentDir;
+	int				result;
 
 	if( argc > 2 )
 	{
@@ -360,26 +443,41 @@ int shell_cmd_ls( int argc, char* argv[] )
 		return 0;
 	}
 
-	init_entry_list( &list ); // list 모두 0으로 set
-	if( g_fsOprs.read_dir( &g_disk, &g_fsOprs, &g_currentDir, &list ) ) // fs_read_dir실행해서 list에 정보 받아옴
+	if( argc == 2 )
+	{ // 경로가 주어지면 그 디렉토리를 출력
+		if( g_fsOprs.lookup_path( &g_disk, &g_fsOprs, &g_currentDir, &dir, argv[1] ) )
+		{
+			printf( "%s not found\n", argv[1] );
+			return -1;
+		}
+		if( !dir.isDirectory )
+		{
+			printf( "%s is not a directory\n", argv[1] );
+			return -1;
+		}
+	}
+
+	if( g_fsOprs.open_dir( &g_disk, &g_fsOprs, &dir, &cursor ) ) // list를 만들지 않고 entry를 하나씩 읽음
 	{
 		printf( "Failed to read_dir\n" );
 		return -1;
 	}
 
-	current = list.first; //current를 리스트의 처음으로 초기화
-
 	printf( "[File names] [D] [File sizes]\n" );
-	while( current )
+	while( ( result = g_fsOprs.read_dir_next( &g_disk, &g_fsOprs, &cursor, &entry ) ) > 0 )
 	{
 		printf( "%-12s  %1d  %12d\n",
-				current->entry.name, current->entry.isDirectory, current->entry.size );
-		current = current->next;
-		//list를 돌면서 파일 정보 출력
+				entry.name, entry.isDirectory, entry.size );
 	}
 	printf( "\n" );
 
-	release_entry_list( &list ); // 리스트 해제
+	g_fsOprs.close_dir( &g_disk, &g_fsOprs, &cursor );
+	if( result < 0 )
+	{
+		printf( "Failed to read_dir\n" );
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -468,9 +566,9 @@ int shell_cmd_rmdir( int argc, char* argv[] )
 
 int shell_cmd_mkdirst( int argc, char* argv[] ) // 입력한 숫자만큼 dir 생성
 {
-	SHELL_ENTRY	entry;
-	int		result, i, count;
-	char	buf[10];
+	int		result, i, count = 0;
+	char	( *buf )[12];
+	const char**	names;
 
 	if( argc != 2 )
 	{
@@ -479,16 +577,33 @@ int shell_cmd_mkdirst( int argc, char* argv[] ) // 입력한 숫자만큼 dir 
 	}
 
 	sscanf( argv[1], "%d", &count );
+	if( count <= 0 )
+		return 0;
+
+	buf = malloc( count * sizeof( *buf ) );
+	names = malloc( count * sizeof( char* ) );
+	if( buf == NULL || names == NULL )
+	{
+		free( buf );
+		free( names );
+		printf( "cannot create directory\n" );
+		return -1;
+	}
+
 	for( i = 0; i < count; i++ )
 	{
-		sprintf( buf, "%d", i );
-		result = g_fsOprs.mkdir( &g_disk, &g_fsOprs, &g_currentDir, buf, &entry ); //입력받은 count 만큼 mkdir 실행
+		sprintf( buf[i], "%d", i );
+		names[i] = buf[i];
+	}
 
-		if( result )
-		{
-			printf( "cannot create directory\n" );
-			return -1;
-		}
+	result = g_fsOprs.mkdir_batch( &g_disk, &g_fsOprs, &g_currentDir, names, count ); // 이름 검사와 생성을 한번에
+	free( buf );
+	free( names );
+
+	if( result )
+	{
+		printf( "cannot create directory\n" );
+		return -1;
 	}
 
 	return 0;
@@ -507,7 +622,7 @@ int shell_cmd_cat( int argc, char* argv[] )
 		return 0;
 	}
 
-	result = g_fsOprs.lookup( &g_disk, &g_fsOprs, &g_currentDir, &entry, argv[1] ); // 인자로 받은 파일없으면 오류메세지
+	result = g_fsOprs.lookup_path( &g_disk, &g_fsOprs, &g_currentDir, &entry, argv[1] ); // 인자로 받은 파일없으면 오류메세지, 경로도 가능
 	if( result )
 	{
 		printf( "%s lookup failed\n", argv[1] );
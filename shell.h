@@ -14,6 +14,9 @@
 
 #include "disk.h"
 
+#define SHELL_ENTRY_NAME_LENGTH		16		/* an 8.3 name with its dot and terminating 0 fits */
+#define SHELL_ENTRY_PDATA_SIZE		64		/* most a file system may declare as nodeSize */
+
 typedef struct
 {
 	unsigned short	year;
@@ -36,7 +39,7 @@ typedef struct SHELL_ENTRY
 {
 	struct SHELL_ENTRY*	parent;
 
-	unsigned char		name[256];
+	unsigned char		name[SHELL_ENTRY_NAME_LENGTH];
 	unsigned char		isDirectory;
 	unsigned int		size;
 
@@ -45,34 +48,37 @@ typedef struct SHELL_ENTRY
 	SHELL_FILETIME		modifyTime;
 
 	/* SHELL_ENTRY would be created frequently.
-	 * In that case, dynamic allocation of a private data is not efficient	*/
-	char				pdata[1024];
+	 * In that case, dynamic allocation of a private data is not efficient.
+	 * The file system uses the first nodeSize bytes of it */
+	union
+	{
+		char			pdata[SHELL_ENTRY_PDATA_SIZE];
+		void*			align;		/* the private data holds pointers */
+	};
 } SHELL_ENTRY;
 
-typedef struct SHELL_ENTRY_LIST_ITEM
-{
-	struct SHELL_ENTRY				entry;
-	struct SHELL_ENTRY_LIST_ITEM*	next;
-} SHELL_ENTRY_LIST_ITEM;
+struct SHELL_FILE_OPERATIONS;
 
+/* an open directory listing, the file system keeps its position in pdata */
 typedef struct
 {
-	unsigned int					count;
-	SHELL_ENTRY_LIST_ITEM*			first;
-	SHELL_ENTRY_LIST_ITEM*			last;
-} SHELL_ENTRY_LIST;
-
-struct SHELL_FILE_OPERATIONS;
+	void*	pdata;
+} SHELL_DIR;
 
 typedef struct SHELL_FS_OPERATIONS
 {
-	int	( *read_dir )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, const SHELL_ENTRY*, SHELL_ENTRY_LIST* );
+	int	( *open_dir )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, const SHELL_ENTRY*, SHELL_DIR* );
+	int	( *read_dir_next )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, SHELL_DIR*, SHELL_ENTRY* );
+	void	( *close_dir )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, SHELL_DIR* );
 	int	( *stat )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, unsigned int*, unsigned int* );
 	int ( *mkdir )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, const SHELL_ENTRY*, const char*, SHELL_ENTRY* );
+	int ( *mkdir_batch )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, const SHELL_ENTRY*, const char* const*, unsigned int );
 	int ( *rmdir )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, const SHELL_ENTRY*, const char* );
 	int ( *lookup )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, const SHELL_ENTRY*, SHELL_ENTRY*, const char* );
+	int ( *lookup_path )( DISK_OPERATIONS*, struct SHELL_FS_OPERATIONS*, const SHELL_ENTRY*, SHELL_ENTRY*, const char* );
 
 	struct SHELL_FILE_OPERATIONS*	fileOprs;
+	unsigned int	nodeSize;		/* bytes of SHELL_ENTRY.pdata the file system uses */
 	void*	pdata;
 } SHELL_FS_OPERATIONS;
 
@@ -88,12 +94,8 @@ typedef struct
 {
 	char*	name;
 	int		( *mount )( DISK_OPERATIONS*, SHELL_FS_OPERATIONS*, SHELL_ENTRY* );
-	void	( *umount )( DISK_OPERATIONS*, SHELL_FS_OPERATIONS* );
+	int		( *umount )( DISK_OPERATIONS*, SHELL_FS_OPERATIONS* );
 	int		( *format )( DISK_OPERATIONS*, void* );
 } SHELL_FILESYSTEM;
 
-int		init_entry_list( SHELL_ENTRY_LIST* list );
-int		add_entry_list( SHELL_ENTRY_LIST*, struct SHELL_ENTRY* );
-void	release_entry_list( SHELL_ENTRY_LIST* );
-
 #endif